@@ -0,0 +1,141 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "arena.h"
+
+globus_result_t
+arena_init(arena_t ** Arena)
+{
+	GlobusGFSName(arena_init);
+
+	*Arena = malloc(sizeof(arena_t));
+	if (!*Arena)
+		return GlobusGFSErrorMemory("arena_t");
+	memset(*Arena, 0, sizeof(arena_t));
+	return GLOBUS_SUCCESS;
+}
+
+void *
+arena_alloc(arena_t * Arena, size_t Size)
+{
+	void          * ptr   = NULL;
+	arena_chunk_t * chunk = NULL;
+
+	/* Keep allocations aligned for anything. */
+	Size = (Size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	/* Move on through chunks kept from before the last reset. */
+	while ((chunk = Arena->Current) && chunk->Size - chunk->Used < Size)
+	{
+		if (!chunk->Next)
+			break;
+		Arena->Current = chunk->Next;
+	}
+
+	if (!chunk || chunk->Size - chunk->Used < Size)
+	{
+		size_t size = Size > ARENA_CHUNK_SIZE ? Size : ARENA_CHUNK_SIZE;
+
+		chunk = malloc(sizeof(arena_chunk_t) + size);
+		if (!chunk)
+			return NULL;
+		chunk->Next = NULL;
+		chunk->Size = size;
+		chunk->Used = 0;
+
+		if (Arena->Current)
+			Arena->Current->Next = chunk;
+		else
+			Arena->Chunks = chunk;
+		Arena->Current = chunk;
+	}
+
+	ptr = chunk->Data + chunk->Used;
+	chunk->Used += Size;
+	return ptr;
+}
+
+char *
+arena_strdup(arena_t * Arena, const char * String)
+{
+	size_t length = strlen(String) + 1;
+	char * copy   = arena_alloc(Arena, length);
+
+	if (copy)
+		memcpy(copy, String, length);
+	return copy;
+}
+
+void
+arena_reset(arena_t * Arena)
+{
+	arena_chunk_t * chunk = NULL;
+
+	for (chunk = Arena->Chunks; chunk; chunk = chunk->Next)
+	{
+		chunk->Used = 0;
+	}
+	Arena->Current = Arena->Chunks;
+}
+
+void
+arena_destroy(arena_t * Arena)
+{
+	arena_chunk_t * chunk = NULL;
+
+	if (!Arena)
+		return;
+
+	while ((chunk = Arena->Chunks))
+	{
+		Arena->Chunks = chunk->Next;
+		free(chunk);
+	}
+	free(Arena);
+}
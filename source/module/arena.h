@@ -0,0 +1,89 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_ARENA_H
+#define HPSS_DSI_ARENA_H
+
+/*
+ * System includes
+ */
+#include <stddef.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Bump allocator for short lived strings. Nothing is freed on its own;
+ * arena_reset() releases everything at once and keeps the chunks for reuse.
+ */
+
+#define ARENA_CHUNK_SIZE (64*1024)
+
+typedef struct arena_chunk {
+	struct arena_chunk * Next;
+	size_t               Size;
+	size_t               Used;
+	char                 Data[];
+} arena_chunk_t;
+
+typedef struct {
+	arena_chunk_t * Chunks;
+	arena_chunk_t * Current;
+} arena_t;
+
+globus_result_t
+arena_init(arena_t ** Arena);
+
+/* Returns NULL if out of memory. */
+void *
+arena_alloc(arena_t * Arena, size_t Size);
+
+char *
+arena_strdup(arena_t * Arena, const char * String);
+
+void
+arena_reset(arena_t * Arena);
+
+void
+arena_destroy(arena_t * Arena);
+
+#endif /* HPSS_DSI_ARENA_H */
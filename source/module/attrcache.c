@@ -0,0 +1,296 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "attrcache.h"
+#include "telemetry.h"
+
+static unsigned int
+attrcache_hash(const char * Path, size_t Length)
+{
+	size_t       i    = 0;
+	unsigned int hash = 5381;
+
+	for (i = 0; i < Length; i++)
+	{
+		hash = ((hash << 5) + hash) + (unsigned char)Path[i];
+	}
+	return hash % ATTRCACHE_BUCKETS;
+}
+
+static void
+attrcache_free_entry(attrcache_entry_t * Entry)
+{
+	free(Entry->Path);
+	free(Entry);
+}
+
+/* Called locked. Drops entries for Path, or expired entries if Path is NULL. */
+static void
+attrcache_remove(attrcache_t * Cache, const char * Path, size_t Length)
+{
+	int                  i     = 0;
+	uint64_t             now   = telemetry_now();
+	attrcache_entry_t ** prev  = NULL;
+	attrcache_entry_t  * entry = NULL;
+
+	for (i = 0; i < ATTRCACHE_BUCKETS; i++)
+	{
+		if (Path && i != attrcache_hash(Path, Length))
+			continue;
+
+		prev = &Cache->Buckets[i];
+		while ((entry = *prev))
+		{
+			if (Path ? (strlen(entry->Path) == Length && strncmp(entry->Path, Path, Length) == 0)
+			         : entry->Expires <= now)
+			{
+				*prev = entry->Next;
+				attrcache_free_entry(entry);
+				Cache->EntryCnt--;
+				continue;
+			}
+			prev = &entry->Next;
+		}
+	}
+}
+
+/* Called locked. */
+static void
+attrcache_clear(attrcache_t * Cache)
+{
+	int                 i     = 0;
+	attrcache_entry_t * entry = NULL;
+
+	for (i = 0; i < ATTRCACHE_BUCKETS; i++)
+	{
+		while ((entry = Cache->Buckets[i]))
+		{
+			Cache->Buckets[i] = entry->Next;
+			attrcache_free_entry(entry);
+		}
+	}
+	Cache->EntryCnt = 0;
+}
+
+static int
+attrcache_lookup(attrcache_t * Cache, char * Path, int Follow, hpss_stat_t * Stat)
+{
+	int                 rc     = 0;
+	int                 found  = 0;
+	size_t              length = strlen(Path);
+	unsigned int        bucket = attrcache_hash(Path, length);
+	attrcache_entry_t * entry  = NULL;
+
+	if (!Cache)
+		return Follow ? hpss_Stat(Path, Stat) : hpss_Lstat(Path, Stat);
+
+	pthread_mutex_lock(&Cache->Lock);
+	{
+		for (entry = Cache->Buckets[bucket]; entry; entry = entry->Next)
+		{
+			if (entry->Follow == Follow && strcmp(entry->Path, Path) == 0)
+			{
+				if (entry->Expires > telemetry_now())
+				{
+					*Stat = entry->Stat;
+					found = 1;
+				}
+				break;
+			}
+		}
+
+		if (found)
+			Cache->Hits++;
+		else
+			Cache->Misses++;
+	}
+	pthread_mutex_unlock(&Cache->Lock);
+
+	if (found)
+		return 0;
+
+	rc = Follow ? hpss_Stat(Path, Stat) : hpss_Lstat(Path, Stat);
+	if (rc)
+		return rc;
+
+	/* Caching is best effort; a failure here only costs the next lookup. */
+	entry = malloc(sizeof(attrcache_entry_t));
+	if (!entry)
+		return 0;
+	entry->Path = strdup(Path);
+	if (!entry->Path)
+	{
+		free(entry);
+		return 0;
+	}
+	entry->Follow  = Follow;
+	entry->Stat    = *Stat;
+	entry->Expires = telemetry_now() + Cache->TTL;
+
+	pthread_mutex_lock(&Cache->Lock);
+	{
+		attrcache_entry_t ** prev = &Cache->Buckets[bucket];
+		attrcache_entry_t  * old  = NULL;
+
+		/* Replace the stale entry, if any. */
+		while ((old = *prev))
+		{
+			if (old->Follow == Follow && strcmp(old->Path, Path) == 0)
+			{
+				*prev = old->Next;
+				attrcache_free_entry(old);
+				Cache->EntryCnt--;
+				break;
+			}
+			prev = &old->Next;
+		}
+
+		if (Cache->EntryCnt >= ATTRCACHE_MAX_ENTRIES)
+			attrcache_remove(Cache, NULL, 0);
+		if (Cache->EntryCnt >= ATTRCACHE_MAX_ENTRIES)
+			attrcache_clear(Cache);
+
+		entry->Next = Cache->Buckets[bucket];
+		Cache->Buckets[bucket] = entry;
+		Cache->EntryCnt++;
+	}
+	pthread_mutex_unlock(&Cache->Lock);
+
+	return 0;
+}
+
+globus_result_t
+attrcache_init(attrcache_t ** Cache, int TTL)
+{
+	GlobusGFSName(attrcache_init);
+
+	*Cache = NULL;
+	if (TTL <= 0)
+		return GLOBUS_SUCCESS;
+
+	*Cache = malloc(sizeof(attrcache_t));
+	if (!*Cache)
+		return GlobusGFSErrorMemory("attrcache_t");
+
+	memset(*Cache, 0, sizeof(attrcache_t));
+	pthread_mutex_init(&(*Cache)->Lock, NULL);
+	(*Cache)->TTL = (uint64_t)TTL * 1000000;
+	return GLOBUS_SUCCESS;
+}
+
+void
+attrcache_destroy(attrcache_t * Cache)
+{
+	if (!Cache)
+		return;
+
+	if (Cache->Hits + Cache->Misses)
+		globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+		    "Attribute cache: %llu hits, %llu misses (%llu%% hit rate)\n",
+		    (unsigned long long)Cache->Hits,
+		    (unsigned long long)Cache->Misses,
+		    (unsigned long long)(Cache->Hits * 100 / (Cache->Hits + Cache->Misses)));
+
+	attrcache_clear(Cache);
+	pthread_mutex_destroy(&Cache->Lock);
+	free(Cache);
+}
+
+int
+attrcache_stat(attrcache_t * Cache, char * Path, hpss_stat_t * Stat)
+{
+	return attrcache_lookup(Cache, Path, 1, Stat);
+}
+
+int
+attrcache_lstat(attrcache_t * Cache, char * Path, hpss_stat_t * Stat)
+{
+	return attrcache_lookup(Cache, Path, 0, Stat);
+}
+
+void
+attrcache_invalidate(attrcache_t * Cache, char * Path)
+{
+	size_t length = 0;
+	size_t parent = 0;
+
+	if (!Cache || !Path)
+		return;
+
+	length = strlen(Path);
+	while (length > 1 && Path[length-1] == '/')
+		length--;
+
+	parent = length;
+	while (parent > 0 && Path[parent-1] != '/')
+		parent--;
+
+	pthread_mutex_lock(&Cache->Lock);
+	{
+		attrcache_remove(Cache, Path, length);
+
+		/* The parent's times and link count change too. */
+		if (parent > 0)
+			attrcache_remove(Cache, Path, parent == 1 ? 1 : parent - 1);
+	}
+	pthread_mutex_unlock(&Cache->Lock);
+}
+
+void
+attrcache_invalidate_all(attrcache_t * Cache)
+{
+	if (!Cache)
+		return;
+
+	pthread_mutex_lock(&Cache->Lock);
+	{
+		attrcache_clear(Cache);
+	}
+	pthread_mutex_unlock(&Cache->Lock);
+}
@@ -0,0 +1,115 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_ATTRCACHE_H
+#define HPSS_DSI_ATTRCACHE_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * HPSS includes
+ */
+#include <hpss_api.h>
+
+/*
+ * Per session cache of hpss_Stat() and hpss_Lstat() results, keyed by path.
+ * Entries live for TTL seconds or until the path is invalidated. Anything
+ * in this session that changes a path must invalidate it. Changes made by
+ * other sessions, or to the target of a symlink, show up when the entry
+ * expires.
+ */
+
+#define ATTRCACHE_BUCKETS     256
+#define ATTRCACHE_MAX_ENTRIES 4096
+
+typedef struct attrcache_entry {
+	char                   * Path;
+	int                      Follow; // hpss_Stat() instead of hpss_Lstat()
+	uint64_t                 Expires;
+	hpss_stat_t              Stat;
+	struct attrcache_entry * Next;
+} attrcache_entry_t;
+
+typedef struct {
+	pthread_mutex_t     Lock;
+	uint64_t            TTL;   // Microseconds
+	int                 EntryCnt;
+	attrcache_entry_t * Buckets[ATTRCACHE_BUCKETS];
+
+	uint64_t            Hits;
+	uint64_t            Misses;
+} attrcache_t;
+
+/* TTL of 0 disables the cache; *Cache is set to NULL. */
+globus_result_t
+attrcache_init(attrcache_t ** Cache, int TTL);
+
+/* Logs the hit rate. */
+void
+attrcache_destroy(attrcache_t * Cache);
+
+/*
+ * Same return values as hpss_Stat() and hpss_Lstat(). Cache may be NULL.
+ * Failures are not cached.
+ */
+int
+attrcache_stat(attrcache_t * Cache, char * Path, hpss_stat_t * Stat);
+
+int
+attrcache_lstat(attrcache_t * Cache, char * Path, hpss_stat_t * Stat);
+
+/* Drops Path and its parent directory. */
+void
+attrcache_invalidate(attrcache_t * Cache, char * Path);
+
+/* For renames and removals that change paths below a directory. */
+void
+attrcache_invalidate_all(attrcache_t * Cache);
+
+#endif /* HPSS_DSI_ATTRCACHE_H */
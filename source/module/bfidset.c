@@ -0,0 +1,247 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "bfidset.h"
+
+/* FNV-1a over the ID's bytes. */
+static uint32_t
+bfidset_hash(hpssoid_t * BitfileId)
+{
+	size_t          i     = 0;
+	uint32_t        hash  = 2166136261u;
+	unsigned char * bytes = (unsigned char *)BitfileId;
+
+	for (i = 0; i < sizeof(hpssoid_t); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Locks the ID's stripe and returns the link that points at its entry. */
+static bfidset_entry_t **
+bfidset_find(bfidset_t * Set, hpssoid_t * BitfileId, bfidset_stripe_t ** Stripe)
+{
+	uint32_t           hash  = bfidset_hash(BitfileId);
+	bfidset_entry_t ** prev  = NULL;
+
+	*Stripe = &Set->Stripes[hash % BFIDSET_STRIPES];
+	pthread_mutex_lock(&(*Stripe)->Lock);
+
+	prev = &(*Stripe)->Buckets[(hash / BFIDSET_STRIPES) % BFIDSET_BUCKETS];
+	for (; *prev; prev = &(*prev)->Next)
+	{
+		if (memcmp(&(*prev)->BitfileId, BitfileId, sizeof(hpssoid_t)) == 0)
+			break;
+	}
+	return prev;
+}
+
+void
+bfidset_init(bfidset_t * Set, time_t TTL)
+{
+	int i = 0;
+
+	memset(Set, 0, sizeof(bfidset_t));
+	Set->TTL = TTL;
+	for (i = 0; i < BFIDSET_STRIPES; i++)
+	{
+		pthread_mutex_init(&Set->Stripes[i].Lock, NULL);
+	}
+}
+
+int
+bfidset_insert(bfidset_t * Set, hpssoid_t * BitfileId, void * Value)
+{
+	int                exists = 0;
+	bfidset_stripe_t * stripe = NULL;
+	bfidset_entry_t ** prev   = bfidset_find(Set, BitfileId, &stripe);
+	bfidset_entry_t  * entry  = NULL;
+
+	{
+		if (*prev)
+		{
+			exists = 1;
+		} else if ((entry = malloc(sizeof(bfidset_entry_t))))
+		{
+			entry->BitfileId = *BitfileId;
+			entry->Timestamp = time(NULL);
+			entry->Value     = Value;
+			entry->Next      = NULL;
+			*prev = entry;
+
+			stripe->Stats.Count++;
+			stripe->Stats.Inserts++;
+		}
+	}
+	pthread_mutex_unlock(&stripe->Lock);
+
+	/* Out of memory; the caller goes on untracked. */
+	if (!exists && !entry)
+		return -1;
+	return exists;
+}
+
+void *
+bfidset_lookup(bfidset_t * Set, hpssoid_t * BitfileId)
+{
+	void             * value  = NULL;
+	bfidset_stripe_t * stripe = NULL;
+	bfidset_entry_t ** prev   = bfidset_find(Set, BitfileId, &stripe);
+
+	{
+		stripe->Stats.Lookups++;
+		if (*prev)
+		{
+			stripe->Stats.Hits++;
+			value = (*prev)->Value;
+		}
+	}
+	pthread_mutex_unlock(&stripe->Lock);
+
+	return value;
+}
+
+void *
+bfidset_remove(bfidset_t * Set, hpssoid_t * BitfileId)
+{
+	void             * value  = NULL;
+	bfidset_stripe_t * stripe = NULL;
+	bfidset_entry_t ** prev   = bfidset_find(Set, BitfileId, &stripe);
+	bfidset_entry_t  * entry  = *prev;
+
+	{
+		if (entry)
+		{
+			*prev = entry->Next;
+			value = entry->Value;
+			free(entry);
+
+			stripe->Stats.Count--;
+			stripe->Stats.Removes++;
+		}
+	}
+	pthread_mutex_unlock(&stripe->Lock);
+
+	return value;
+}
+
+void
+bfidset_touch(bfidset_t * Set, hpssoid_t * BitfileId)
+{
+	bfidset_stripe_t * stripe = NULL;
+	bfidset_entry_t ** prev   = bfidset_find(Set, BitfileId, &stripe);
+
+	{
+		if (*prev)
+			(*prev)->Timestamp = time(NULL);
+	}
+	pthread_mutex_unlock(&stripe->Lock);
+}
+
+void
+bfidset_expire(bfidset_t * Set, bfidset_expire_t Expire, void * Arg)
+{
+	int                i      = 0;
+	int                j      = 0;
+	time_t             cutoff = time(NULL) - Set->TTL;
+	bfidset_stripe_t * stripe = NULL;
+	bfidset_entry_t ** prev   = NULL;
+	bfidset_entry_t  * entry  = NULL;
+
+	for (i = 0; i < BFIDSET_STRIPES; i++)
+	{
+		stripe = &Set->Stripes[i];
+
+		pthread_mutex_lock(&stripe->Lock);
+		for (j = 0; j < BFIDSET_BUCKETS; j++)
+		{
+			prev = &stripe->Buckets[j];
+			while ((entry = *prev))
+			{
+				if (entry->Timestamp > cutoff)
+				{
+					prev = &entry->Next;
+					continue;
+				}
+
+				*prev = entry->Next;
+				if (Expire)
+					Expire(entry->Value, Arg);
+				free(entry);
+
+				stripe->Stats.Count--;
+				stripe->Stats.Expired++;
+			}
+		}
+		pthread_mutex_unlock(&stripe->Lock);
+	}
+}
+
+void
+bfidset_get_stats(bfidset_t * Set, bfidset_stats_t * Stats)
+{
+	int i = 0;
+
+	memset(Stats, 0, sizeof(bfidset_stats_t));
+	for (i = 0; i < BFIDSET_STRIPES; i++)
+	{
+		pthread_mutex_lock(&Set->Stripes[i].Lock);
+		{
+			Stats->Count   += Set->Stripes[i].Stats.Count;
+			Stats->Lookups += Set->Stripes[i].Stats.Lookups;
+			Stats->Hits    += Set->Stripes[i].Stats.Hits;
+			Stats->Inserts += Set->Stripes[i].Stats.Inserts;
+			Stats->Removes += Set->Stripes[i].Stats.Removes;
+			Stats->Expired += Set->Stripes[i].Stats.Expired;
+		}
+		pthread_mutex_unlock(&Set->Stripes[i].Lock);
+	}
+}
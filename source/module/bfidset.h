@@ -0,0 +1,125 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_BFIDSET_H
+#define HPSS_DSI_BFIDSET_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * HPSS includes
+ */
+#include <hpss_api.h>
+
+/*
+ * Thread safe set of bitfile IDs, each with a value and a timestamp. The
+ * set is split into stripes, each with its own lock, so lookups from
+ * different threads rarely contend. Entries whose timestamp is older than
+ * TTL seconds are removed by bfidset_expire().
+ */
+
+#define BFIDSET_STRIPES 16
+#define BFIDSET_BUCKETS 64 // Per stripe
+
+typedef struct bfidset_entry {
+	hpssoid_t              BitfileId;
+	time_t                 Timestamp;
+	void                 * Value;
+	struct bfidset_entry * Next;
+} bfidset_entry_t;
+
+typedef struct {
+	uint64_t Count;
+	uint64_t Lookups;
+	uint64_t Hits;
+	uint64_t Inserts;
+	uint64_t Removes;
+	uint64_t Expired;
+} bfidset_stats_t;
+
+typedef struct {
+	pthread_mutex_t   Lock;
+	bfidset_entry_t * Buckets[BFIDSET_BUCKETS];
+	bfidset_stats_t   Stats;
+} bfidset_stripe_t;
+
+typedef struct {
+	time_t           TTL;
+	bfidset_stripe_t Stripes[BFIDSET_STRIPES];
+} bfidset_t;
+
+/* Called with the entry's stripe locked; must not call back into the set. */
+typedef void (*bfidset_expire_t) (void * Value, void * Arg);
+
+void
+bfidset_init(bfidset_t * Set, time_t TTL);
+
+/*
+ * Returns 0 if added, 1 if BitfileId was already in the set, -1 if out of
+ * memory.
+ */
+int
+bfidset_insert(bfidset_t * Set, hpssoid_t * BitfileId, void * Value);
+
+/* Returns the value, or NULL if BitfileId is not in the set. */
+void *
+bfidset_lookup(bfidset_t * Set, hpssoid_t * BitfileId);
+
+/* Returns the value, or NULL if BitfileId was not in the set. */
+void *
+bfidset_remove(bfidset_t * Set, hpssoid_t * BitfileId);
+
+/* Restarts the entry's TTL. */
+void
+bfidset_touch(bfidset_t * Set, hpssoid_t * BitfileId);
+
+/* Removes entries older than the TTL, handing each value to Expire. */
+void
+bfidset_expire(bfidset_t * Set, bfidset_expire_t Expire, void * Arg);
+
+void
+bfidset_get_stats(bfidset_t * Set, bfidset_stats_t * Stats);
+
+#endif /* HPSS_DSI_BFIDSET_H */
@@ -0,0 +1,120 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * Local includes
+ */
+#include "blocksize.h"
+
+/* Keep growing until each stripe would see fewer than this many blocks. */
+#define BLOCKSIZE_BLOCKS_PER_STRIPE 8
+
+static globus_size_t
+blocksize_round_pow2(globus_size_t Size)
+{
+	globus_size_t size = 1;
+
+	while (size < Size)
+		size <<= 1;
+	return size;
+}
+
+globus_size_t
+blocksize_class(config_t * Config, globus_size_t Size)
+{
+	if (Size < Config->MinBlockSize)
+		Size = Config->MinBlockSize;
+	return blocksize_round_pow2(Size);
+}
+
+globus_size_t
+blocksize_select(config_t      * Config,
+                 const char    * Pathname,
+                 globus_size_t   DefaultBlockSize,
+                 globus_off_t    FileSize,
+                 int             FileStripeWidth,
+                 globus_off_t    OptimumAccessSize)
+{
+	globus_size_t block_size   = 0;
+	globus_size_t min_size     = Config->MinBlockSize;
+	globus_size_t max_size     = Config->MaxBlockSize;
+	int           stripe_width = FileStripeWidth > 0 ? FileStripeWidth : 1;
+
+	if (!Config->AdaptiveBlockSize)
+		return DefaultBlockSize;
+
+	if (max_size < min_size)
+		max_size = min_size;
+
+	block_size = OptimumAccessSize > 0 ? OptimumAccessSize : DefaultBlockSize;
+	block_size = blocksize_round_pow2(block_size);
+
+	if (FileSize >= 0)
+	{
+		/* A small file needs no more than one block. */
+		while (block_size > min_size && (block_size >> 1) >= FileSize)
+			block_size >>= 1;
+
+		/* A large file wants fewer, larger blocks per stripe. */
+		while ((block_size << 1) <= max_size &&
+		       FileSize / stripe_width >= (globus_off_t)(block_size << 1) * BLOCKSIZE_BLOCKS_PER_STRIPE)
+		{
+			block_size <<= 1;
+		}
+	}
+
+	if (block_size < min_size)
+		block_size = min_size;
+	if (block_size > max_size)
+		block_size = max_size;
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "HPSS DSI: block size %lu for %s "
+	                       "(file size %"GLOBUS_OFF_T_FORMAT", stripe width %d, "
+	                       "optimum access size %llu, server block size %lu)\n",
+	                       (unsigned long)block_size,
+	                       Pathname,
+	                       FileSize,
+	                       FileStripeWidth,
+	                       (unsigned long long)OptimumAccessSize,
+	                       (unsigned long)DefaultBlockSize);
+
+	return block_size;
+}
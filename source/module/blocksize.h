@@ -0,0 +1,78 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_BLOCKSIZE_H
+#define HPSS_DSI_BLOCKSIZE_H
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "config.h"
+
+/*
+ * Picks the PIO and data channel block size for a transfer. Starts from the
+ * COS optimum access size (or the server's block size if there is none),
+ * shrinks it for files smaller than a block and grows it until each file
+ * stripe gets a reasonable number of blocks. The result is a power of 2
+ * within MinBlockSize and MaxBlockSize. Returns DefaultBlockSize unchanged
+ * unless AdaptiveBlockSize is on. FileSize is -1 if unknown.
+ */
+globus_size_t
+blocksize_select(config_t      * Config,
+                 const char    * Pathname,
+                 globus_size_t   DefaultBlockSize,
+                 globus_off_t    FileSize,
+                 int             FileStripeWidth,
+                 globus_off_t    OptimumAccessSize);
+
+/*
+ * Rounds a buffer size up to a power of 2 no smaller than MinBlockSize, the
+ * sizes blocksize_select() hands out, so that odd sized buffers share buffer
+ * pool classes with the PIO blocks.
+ */
+globus_size_t
+blocksize_class(config_t * Config, globus_size_t Size);
+
+#endif /* HPSS_DSI_BLOCKSIZE_H */
@@ -0,0 +1,585 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdio.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/*
+ * Local includes
+ */
+#include "checksum.h"
+#include "dl.h"
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new  EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+static struct {
+	checksum_type_t Type;
+	const char    * Name;
+} _checksum_types[] = {
+	{CHECKSUM_MD5,     "md5"},
+	{CHECKSUM_SHA1,    "sha1"},
+	{CHECKSUM_SHA256,  "sha256"},
+	{CHECKSUM_SHA512,  "sha512"},
+	{CHECKSUM_ADLER32, "adler32"},
+	{CHECKSUM_CRC32C,  "crc32c"},
+	{CHECKSUM_XXH64,   "xxh64"},
+};
+
+#define CHECKSUM_TYPE_COUNT (sizeof(_checksum_types)/sizeof(*_checksum_types))
+
+/*
+ * ADLER32
+ */
+
+/* Largest n such that 255n(n+1)/2 + (n+1)(65520) fits in 32 bits. */
+#define ADLER32_NMAX 5552
+#define ADLER32_BASE 65521
+
+static void
+checksum_adler32_update(uint32_t * Adler, const unsigned char * Buffer, uint32_t Length)
+{
+	uint32_t a = *Adler & 0xFFFF;
+	uint32_t b = *Adler >> 16;
+	uint32_t n = 0;
+
+	while (Length > 0)
+	{
+		n = Length < ADLER32_NMAX ? Length : ADLER32_NMAX;
+		Length -= n;
+
+		/* Defer the modulo until the sums might overflow. */
+		while (n >= 8)
+		{
+			a += Buffer[0]; b += a;
+			a += Buffer[1]; b += a;
+			a += Buffer[2]; b += a;
+			a += Buffer[3]; b += a;
+			a += Buffer[4]; b += a;
+			a += Buffer[5]; b += a;
+			a += Buffer[6]; b += a;
+			a += Buffer[7]; b += a;
+			Buffer += 8;
+			n -= 8;
+		}
+		while (n--)
+		{
+			a += *Buffer++;
+			b += a;
+		}
+
+		a %= ADLER32_BASE;
+		b %= ADLER32_BASE;
+	}
+
+	*Adler = (b << 16) | a;
+}
+
+/*
+ * CRC32C (Castagnoli)
+ */
+
+static uint32_t _crc32c_table[8][256];
+static int      _crc32c_hw = 0;
+
+static void
+checksum_crc32c_setup()
+{
+	int      i, j;
+	uint32_t crc;
+
+	for (i = 0; i < 256; i++)
+	{
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+		_crc32c_table[0][i] = crc;
+	}
+
+	/* Slicing-by-8 tables. */
+	for (i = 0; i < 256; i++)
+	{
+		crc = _crc32c_table[0][i];
+		for (j = 1; j < 8; j++)
+		{
+			crc = _crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+			_crc32c_table[j][i] = crc;
+		}
+	}
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	_crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t
+checksum_crc32c_sw(uint32_t Crc, const unsigned char * Buffer, uint32_t Length)
+{
+	uint64_t word;
+
+	while (Length && ((uintptr_t)Buffer & 7))
+	{
+		Crc = _crc32c_table[0][(Crc ^ *Buffer++) & 0xFF] ^ (Crc >> 8);
+		Length--;
+	}
+
+	while (Length >= 8)
+	{
+		/* Little endian only, like the hardware path. */
+		memcpy(&word, Buffer, 8);
+		word ^= Crc;
+		Crc = _crc32c_table[7][ word        & 0xFF] ^
+		      _crc32c_table[6][(word >>  8) & 0xFF] ^
+		      _crc32c_table[5][(word >> 16) & 0xFF] ^
+		      _crc32c_table[4][(word >> 24) & 0xFF] ^
+		      _crc32c_table[3][(word >> 32) & 0xFF] ^
+		      _crc32c_table[2][(word >> 40) & 0xFF] ^
+		      _crc32c_table[1][(word >> 48) & 0xFF] ^
+		      _crc32c_table[0][ word >> 56        ];
+		Buffer += 8;
+		Length -= 8;
+	}
+
+	while (Length--)
+		Crc = _crc32c_table[0][(Crc ^ *Buffer++) & 0xFF] ^ (Crc >> 8);
+
+	return Crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t
+checksum_crc32c_hw(uint32_t Crc, const unsigned char * Buffer, uint32_t Length)
+{
+	uint64_t crc = Crc;
+	uint64_t word;
+
+	while (Length && ((uintptr_t)Buffer & 7))
+	{
+		crc = _mm_crc32_u8(crc, *Buffer++);
+		Length--;
+	}
+
+	while (Length >= 8)
+	{
+		memcpy(&word, Buffer, 8);
+		crc = _mm_crc32_u64(crc, word);
+		Buffer += 8;
+		Length -= 8;
+	}
+
+	while (Length--)
+		crc = _mm_crc32_u8(crc, *Buffer++);
+
+	return crc;
+}
+#endif
+
+static void
+checksum_crc32c_update(uint32_t * Crc, const unsigned char * Buffer, uint32_t Length)
+{
+#if defined(__x86_64__)
+	if (_crc32c_hw)
+	{
+		*Crc = checksum_crc32c_hw(*Crc, Buffer, Length);
+		return;
+	}
+#endif
+	*Crc = checksum_crc32c_sw(*Crc, Buffer, Length);
+}
+
+/*
+ * XXH64
+ */
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t
+checksum_xxh64_read64(const uint8_t * Buffer)
+{
+	uint64_t value;
+	memcpy(&value, Buffer, sizeof(value));
+	return value;
+}
+
+static uint32_t
+checksum_xxh64_read32(const uint8_t * Buffer)
+{
+	uint32_t value;
+	memcpy(&value, Buffer, sizeof(value));
+	return value;
+}
+
+static uint64_t
+checksum_xxh64_round(uint64_t Acc, uint64_t Input)
+{
+	Acc += Input * XXH_PRIME64_2;
+	Acc  = XXH_ROTL64(Acc, 31);
+	return Acc * XXH_PRIME64_1;
+}
+
+static uint64_t
+checksum_xxh64_merge(uint64_t Acc, uint64_t Value)
+{
+	Acc ^= checksum_xxh64_round(0, Value);
+	return Acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void
+checksum_xxh64_init(checksum_xxh64_t * State)
+{
+	memset(State, 0, sizeof(*State));
+	State->V[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	State->V[1] = XXH_PRIME64_2;
+	State->V[2] = 0;
+	State->V[3] = -XXH_PRIME64_1;
+}
+
+static void
+checksum_xxh64_update(checksum_xxh64_t * State, const uint8_t * Buffer, uint32_t Length)
+{
+	const uint8_t * end = Buffer + Length;
+	uint32_t        fill;
+
+	State->Total += Length;
+
+	if (State->MemSize + Length < 32)
+	{
+		memcpy(State->Mem + State->MemSize, Buffer, Length);
+		State->MemSize += Length;
+		return;
+	}
+
+	if (State->MemSize)
+	{
+		fill = 32 - State->MemSize;
+		memcpy(State->Mem + State->MemSize, Buffer, fill);
+		State->V[0] = checksum_xxh64_round(State->V[0], checksum_xxh64_read64(State->Mem));
+		State->V[1] = checksum_xxh64_round(State->V[1], checksum_xxh64_read64(State->Mem + 8));
+		State->V[2] = checksum_xxh64_round(State->V[2], checksum_xxh64_read64(State->Mem + 16));
+		State->V[3] = checksum_xxh64_round(State->V[3], checksum_xxh64_read64(State->Mem + 24));
+		Buffer += fill;
+		State->MemSize = 0;
+	}
+
+	while (Buffer + 32 <= end)
+	{
+		State->V[0] = checksum_xxh64_round(State->V[0], checksum_xxh64_read64(Buffer));
+		State->V[1] = checksum_xxh64_round(State->V[1], checksum_xxh64_read64(Buffer + 8));
+		State->V[2] = checksum_xxh64_round(State->V[2], checksum_xxh64_read64(Buffer + 16));
+		State->V[3] = checksum_xxh64_round(State->V[3], checksum_xxh64_read64(Buffer + 24));
+		Buffer += 32;
+	}
+
+	if (Buffer < end)
+	{
+		State->MemSize = end - Buffer;
+		memcpy(State->Mem, Buffer, State->MemSize);
+	}
+}
+
+static uint64_t
+checksum_xxh64_digest(checksum_xxh64_t * State)
+{
+	uint64_t        h64;
+	const uint8_t * p   = State->Mem;
+	const uint8_t * end = State->Mem + State->MemSize;
+
+	if (State->Total >= 32)
+	{
+		h64 = XXH_ROTL64(State->V[0], 1) + XXH_ROTL64(State->V[1], 7) +
+		      XXH_ROTL64(State->V[2], 12) + XXH_ROTL64(State->V[3], 18);
+		h64 = checksum_xxh64_merge(h64, State->V[0]);
+		h64 = checksum_xxh64_merge(h64, State->V[1]);
+		h64 = checksum_xxh64_merge(h64, State->V[2]);
+		h64 = checksum_xxh64_merge(h64, State->V[3]);
+	} else
+	{
+		h64 = State->V[2] + XXH_PRIME64_5;
+	}
+
+	h64 += State->Total;
+
+	while (p + 8 <= end)
+	{
+		h64 ^= checksum_xxh64_round(0, checksum_xxh64_read64(p));
+		h64  = XXH_ROTL64(h64, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+
+	if (p + 4 <= end)
+	{
+		h64 ^= (uint64_t)checksum_xxh64_read32(p) * XXH_PRIME64_1;
+		h64  = XXH_ROTL64(h64, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		h64 ^= (*p) * XXH_PRIME64_5;
+		h64  = XXH_ROTL64(h64, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	h64 ^= h64 >> 33;
+	h64 *= XXH_PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= XXH_PRIME64_3;
+	h64 ^= h64 >> 32;
+
+	return h64;
+}
+
+/*
+ * Engine
+ */
+
+static const EVP_MD *
+checksum_evp_md(checksum_type_t Type)
+{
+	switch (Type)
+	{
+	case CHECKSUM_MD5:
+		return EVP_md5();
+	case CHECKSUM_SHA1:
+		return EVP_sha1();
+	case CHECKSUM_SHA256:
+		return EVP_sha256();
+	case CHECKSUM_SHA512:
+		return EVP_sha512();
+	default:
+		return NULL;
+	}
+}
+
+/* Compare ignoring case and dashes, so SHA-256 matches sha256. */
+static int
+checksum_name_matches(const char * Name, const char * Algorithm)
+{
+	while (*Name || *Algorithm)
+	{
+		if (*Algorithm == '-')
+		{
+			Algorithm++;
+			continue;
+		}
+		if (tolower(*Name) != tolower(*Algorithm))
+			return 0;
+		Name++;
+		Algorithm++;
+	}
+	return 1;
+}
+
+globus_result_t
+checksum_init(checksum_t ** Checksum, const char * Algorithm)
+{
+	static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+	int                   i;
+	const EVP_MD        * md = NULL;
+
+	GlobusGFSName(checksum_init);
+
+	*Checksum = NULL;
+
+	if (!Algorithm)
+		Algorithm = "md5";
+
+	for (i = 0; i < CHECKSUM_TYPE_COUNT; i++)
+	{
+		if (checksum_name_matches(_checksum_types[i].Name, Algorithm))
+			break;
+	}
+	if (i == CHECKSUM_TYPE_COUNT)
+		return GlobusGFSErrorGeneric("Unsupported checksum algorithm");
+
+	*Checksum = malloc(sizeof(checksum_t));
+	if (!*Checksum)
+		return GlobusGFSErrorMemory("checksum_t");
+	memset(*Checksum, 0, sizeof(checksum_t));
+	(*Checksum)->Type = _checksum_types[i].Type;
+
+	switch ((*Checksum)->Type)
+	{
+	case CHECKSUM_ADLER32:
+		(*Checksum)->State.Adler32 = 1;
+		break;
+	case CHECKSUM_CRC32C:
+		pthread_once(&once_control, checksum_crc32c_setup);
+		(*Checksum)->State.CRC32C = 0xFFFFFFFF;
+		break;
+	case CHECKSUM_XXH64:
+		checksum_xxh64_init(&(*Checksum)->State.XXH64);
+		break;
+	default:
+		md = checksum_evp_md((*Checksum)->Type);
+		(*Checksum)->State.EVP = EVP_MD_CTX_new();
+		if (!(*Checksum)->State.EVP || EVP_DigestInit_ex((*Checksum)->State.EVP, md, NULL) != 1)
+		{
+			checksum_destroy(*Checksum);
+			*Checksum = NULL;
+			return GlobusGFSErrorGeneric("Failed to create checksum context");
+		}
+		break;
+	}
+
+	return GLOBUS_SUCCESS;
+}
+
+int
+checksum_update(void * Checksum, const char * Buffer, uint32_t Length)
+{
+	checksum_t * checksum = Checksum;
+
+	switch (checksum->Type)
+	{
+	case CHECKSUM_ADLER32:
+		checksum_adler32_update(&checksum->State.Adler32, (const unsigned char *)Buffer, Length);
+		return 0;
+	case CHECKSUM_CRC32C:
+		checksum_crc32c_update(&checksum->State.CRC32C, (const unsigned char *)Buffer, Length);
+		return 0;
+	case CHECKSUM_XXH64:
+		checksum_xxh64_update(&checksum->State.XXH64, (const uint8_t *)Buffer, Length);
+		return 0;
+	default:
+		return EVP_DigestUpdate(checksum->State.EVP, Buffer, Length) != 1;
+	}
+}
+
+globus_result_t
+checksum_final(checksum_t * Checksum, char ** ChecksumString)
+{
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int  length = 0;
+	unsigned int  i;
+
+	GlobusGFSName(checksum_final);
+
+	*ChecksumString = malloc(2*EVP_MAX_MD_SIZE + 1);
+	if (!*ChecksumString)
+		return GlobusGFSErrorMemory("checksum string");
+
+	switch (Checksum->Type)
+	{
+	case CHECKSUM_ADLER32:
+		sprintf(*ChecksumString, "%08x", Checksum->State.Adler32);
+		break;
+	case CHECKSUM_CRC32C:
+		sprintf(*ChecksumString, "%08x", Checksum->State.CRC32C ^ 0xFFFFFFFF);
+		break;
+	case CHECKSUM_XXH64:
+		sprintf(*ChecksumString, "%016llx",
+		        (unsigned long long)checksum_xxh64_digest(&Checksum->State.XXH64));
+		break;
+	default:
+		if (EVP_DigestFinal_ex(Checksum->State.EVP, digest, &length) != 1)
+		{
+			free(*ChecksumString);
+			*ChecksumString = NULL;
+			return GlobusGFSErrorGeneric("EVP_DigestFinal_ex() failed");
+		}
+
+		for (i = 0; i < length; i++)
+		{
+			sprintf(&((*ChecksumString)[i*2]), "%02x", (unsigned int)digest[i]);
+		}
+		break;
+	}
+
+	return GLOBUS_SUCCESS;
+}
+
+void
+checksum_destroy(checksum_t * Checksum)
+{
+	if (Checksum)
+	{
+		if (checksum_evp_md(Checksum->Type) && Checksum->State.EVP)
+			EVP_MD_CTX_free(Checksum->State.EVP);
+		free(Checksum);
+	}
+}
+
+const char *
+checksum_name(checksum_t * Checksum)
+{
+	int i;
+
+	for (i = 0; i < CHECKSUM_TYPE_COUNT; i++)
+	{
+		if (_checksum_types[i].Type == Checksum->Type)
+			return _checksum_types[i].Name;
+	}
+	return NULL;
+}
+
+typedef globus_result_t (*globus_checksum_support_func_t) (globus_gfs_operation_t Operation,
+                                                           const char           * Algorithms);
+
+void
+checksum_advertise(globus_gfs_operation_t Operation)
+{
+	globus_checksum_support_func_t set_checksum_support = NULL;
+
+	/* Only newer servers let the DSI say which algorithms it has. */
+	set_checksum_support = dl_find_symbol("globus_gridftp_server_set_checksum_support");
+	if (set_checksum_support)
+		set_checksum_support(Operation, "MD5:10;ADLER32:10;CRC32C:10;SHA1:10;SHA256:10;SHA512:10;XXH64:10;");
+}
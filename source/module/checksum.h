@@ -0,0 +1,112 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_CHECKSUM_H
+#define HPSS_DSI_CHECKSUM_H
+
+/*
+ * System includes
+ */
+#include <openssl/evp.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Checksum engine for CKSM. The cryptographic digests go through OpenSSL's
+ * EVP interface, which picks up SHA-NI/AVX2 code paths on its own. The
+ * rest are implemented here; CRC32C uses the SSE4.2 instruction when the
+ * CPU has it.
+ */
+
+typedef enum {
+	CHECKSUM_MD5,
+	CHECKSUM_SHA1,
+	CHECKSUM_SHA256,
+	CHECKSUM_SHA512,
+	CHECKSUM_ADLER32,
+	CHECKSUM_CRC32C,
+	CHECKSUM_XXH64,
+} checksum_type_t;
+
+typedef struct {
+	uint64_t Total;
+	uint64_t V[4];
+	uint8_t  Mem[32];
+	uint32_t MemSize;
+} checksum_xxh64_t;
+
+typedef struct {
+	checksum_type_t Type;
+	union {
+		EVP_MD_CTX       * EVP;
+		uint32_t           Adler32;
+		uint32_t           CRC32C;
+		checksum_xxh64_t   XXH64;
+	} State;
+} checksum_t;
+
+/* Algorithm names are matched without regard to case or dashes. */
+globus_result_t
+checksum_init(checksum_t ** Checksum, const char * Algorithm);
+
+/* Returns 0 on success. Usable as a hasher_update_t. */
+int
+checksum_update(void * Checksum, const char * Buffer, uint32_t Length);
+
+/* Returns the lower case hex digest. */
+globus_result_t
+checksum_final(checksum_t * Checksum, char ** ChecksumString);
+
+void
+checksum_destroy(checksum_t * Checksum);
+
+/* Lower case name, as recorded in the checksum UDA. */
+const char *
+checksum_name(checksum_t * Checksum);
+
+/* Tells the server which algorithms CKSM accepts, if it can be told. */
+void
+checksum_advertise(globus_gfs_operation_t Operation);
+
+#endif /* HPSS_DSI_CHECKSUM_H */
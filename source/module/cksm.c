@@ -50,9 +50,10 @@
 #include "cksm.h"
 #include "stat.h"
 #include "pio.h"
+#include "blocksize.h"
 
 int
-cksm_pio_callout(char     * Buffer,
+cksm_pio_callout(char    ** Buffer,
                  uint32_t * Length,
                  uint64_t   Offset,
                  void     * CallbackArg);
@@ -144,9 +145,10 @@ cksm_stop_markers(cksm_marker_t * Marker)
 }
 
 globus_result_t
-cksm_open_for_reading(char * Pathname,
-	                  int  * FileFD,
-	                  int  * FileStripeWidth)
+cksm_open_for_reading(char         * Pathname,
+	                  int          * FileFD,
+	                  int          * FileStripeWidth,
+	                  globus_off_t * OptimumAccessSize)
 {
 	hpss_cos_hints_t      hints_in;
 	hpss_cos_hints_t      hints_out;
@@ -177,29 +179,34 @@ cksm_open_for_reading(char * Pathname,
 
 	/* Copy out the file stripe width. */
 	*FileStripeWidth = hints_out.StripeWidth;
+	CONVERT_U64_TO_LONGLONG(hints_out.OptimumAccessSize, *OptimumAccessSize);
 
     return GLOBUS_SUCCESS;
 }
 
 int
-cksm_pio_callout(char     * Buffer,
+cksm_pio_callout(char    ** Buffer,
                  uint32_t * Length,
                  uint64_t   Offset,
                  void     * CallbackArg)
 {
-	int           rc        = 0;
-	cksm_info_t * cksm_info = CallbackArg;
+	globus_result_t result    = GLOBUS_SUCCESS;
+	cksm_info_t   * cksm_info = CallbackArg;
+	uint64_t        start     = telemetry_now();
 
 	GlobusGFSName(cksm_pio_callout);
 
 assert(*Length <= cksm_info->BlockSize);
 
-	rc = MD5_Update(&cksm_info->MD5Context, Buffer, *Length);
-	if (rc != 1)
+	/* HPSS reuses this buffer; PIO reads on while the copy is hashed. */
+	result = hasher_submit(cksm_info->Hasher, *Buffer, *Length, Offset);
+	if (result)
 	{
-		cksm_info->Result = GlobusGFSErrorGeneric("MD5_Update() failed");
+		cksm_info->Result = result;
 		return 1;
 	}
+	telemetry_record(&cksm_info->Telemetry, TELEMETRY_WAIT, start);
+	telemetry_add_bytes(&cksm_info->Telemetry, *Length);
 
 	cksm_update_markers(cksm_info->Marker, *Length);
 
@@ -228,9 +235,11 @@ cksm_transfer_complete_callback(globus_result_t Result, void * UserArg)
 	globus_result_t result    = Result;
 	cksm_info_t   * cksm_info = UserArg;
 	int             rc        = 0;
-	unsigned char   md5_digest[MD5_DIGEST_LENGTH];
-	char            cksm_string[2*MD5_DIGEST_LENGTH+1];
-	int             i;
+	char          * cksm_string = NULL;
+	uint64_t        hash_time  = 0;
+	uint64_t        stall_time = 0;
+	uint64_t        start      = 0;
+	globus_result_t hash_result = GLOBUS_SUCCESS;
 
 	GlobusGFSName(cksm_transfer_complete_callback);
 
@@ -238,32 +247,35 @@ cksm_transfer_complete_callback(globus_result_t Result, void * UserArg)
 	if (cksm_info->Result)
 		result = cksm_info->Result;
 
+	/* Let the hasher catch up with the last blocks PIO read. */
+	hash_result = hasher_finish(cksm_info->Hasher, result != GLOBUS_SUCCESS, &hash_time, &stall_time);
+	if (hash_result && !result)
+		result = hash_result;
+	telemetry_set_hash(&cksm_info->Telemetry, hash_time, stall_time);
+
+	start = telemetry_now();
 	rc = hpss_Close(cksm_info->FileFD);
 	if (rc && !result)
 		result = GlobusGFSErrorSystemError("hpss_Close", -rc);
+	telemetry_record(&cksm_info->Telemetry, TELEMETRY_CLOSE, start);
 
 	if (!result)
-	{
-		rc = MD5_Final(md5_digest, &cksm_info->MD5Context);
-		if (rc != 1)
-			result = GlobusGFSErrorGeneric("MD5_Final() failed");
-	}
-
-	if (!result)
-	{
-		for (i = 0; i < MD5_DIGEST_LENGTH; i++)
-		{
-			sprintf(&(cksm_string[i*2]), "%02x", (unsigned int)md5_digest[i]);
-		}
-	}
+		result = checksum_final(cksm_info->Checksum, &cksm_string);
 
 	cksm_stop_markers(cksm_info->Marker);
+	telemetry_finish(&cksm_info->Telemetry, cksm_info->Pathname, result);
 
 	cksm_info->Callback(cksm_info->Operation, result, result ? NULL : cksm_string);
 
 	if (!result && cksm_info->CommandInfo->cksm_offset == 0 && cksm_info->CommandInfo->cksm_length == -1)
-		cksm_set_checksum(cksm_info->Pathname, cksm_info->Config, cksm_string);
-
+		cksm_set_checksum(cksm_info->Pathname,
+		                  cksm_info->Config,
+		                  checksum_name(cksm_info->Checksum),
+		                  cksm_string);
+
+	if (cksm_string)
+		free(cksm_string);
+	checksum_destroy(cksm_info->Checksum);
 	free(cksm_info->Pathname);
 	free(cksm_info);
 }
@@ -279,25 +291,40 @@ cksm(globus_gfs_operation_t      Operation,
 	int             rc                = 0;
 	int             file_stripe_width = 0;
 	char          * checksum_string   = NULL;
+	checksum_t    * checksum          = NULL;
+	globus_off_t    optimum_access_size = 0;
 	hpss_stat_t     hpss_stat_buf;
 
 	GlobusGFSName(cksm);
 
+	result = checksum_init(&checksum, CommandInfo->cksm_alg);
+	if (result)
+	{
+		Callback(Operation, result, NULL);
+		return;
+	}
+
 	if (CommandInfo->cksm_offset == 0 && CommandInfo->cksm_length == -1)
 	{
-		result = checksum_get_file_sum(CommandInfo->pathname, Config, &checksum_string);
+		result = checksum_get_file_sum(CommandInfo->pathname,
+		                               Config,
+		                               checksum_name(checksum),
+		                               &checksum_string);
 		if (result || checksum_string)
 		{
 			Callback(Operation, result, result ? NULL : checksum_string);
 			if (checksum_string) free(checksum_string);
+			checksum_destroy(checksum);
 			return;
 		}
 	}
 
+	/* Not from the attribute cache; the length must be current. */
 	rc = hpss_Stat(CommandInfo->pathname, &hpss_stat_buf);
 	if (rc)
 	{
 		result = GlobusGFSErrorSystemError("hpss_Stat", -rc);
+		checksum_destroy(checksum);
 		Callback(Operation, result, NULL);
 		return;
 	}
@@ -309,6 +336,7 @@ cksm(globus_gfs_operation_t      Operation,
 		goto cleanup;
 	}
 	memset(cksm_info, 0, sizeof(cksm_info_t));
+	cksm_info->Checksum    = checksum;
 	cksm_info->Operation   = Operation;
 	cksm_info->CommandInfo = CommandInfo;
 	cksm_info->Callback    = Callback;
@@ -318,13 +346,9 @@ cksm(globus_gfs_operation_t      Operation,
 	cksm_info->RangeLength = CommandInfo->cksm_length;
 	if (cksm_info->RangeLength == -1)
 		cksm_info->RangeLength  = hpss_stat_buf.st_size - CommandInfo->cksm_offset;
-
-	rc = MD5_Init(&cksm_info->MD5Context);
-	if (rc != 1)
-	{
-		result = GlobusGFSErrorGeneric("Failed to create MD5 context");
-		goto cleanup;
-	}
+	cksm_info->TotalLength = cksm_info->RangeLength;
+	cksm_info->StartTime   = telemetry_now();
+	telemetry_init(&cksm_info->Telemetry, "CKSM");
 
 	globus_gridftp_server_get_block_size(Operation, &cksm_info->BlockSize);
 
@@ -333,20 +357,42 @@ cksm(globus_gfs_operation_t      Operation,
 	 */
 	result = cksm_open_for_reading(CommandInfo->pathname,
 	                               &cksm_info->FileFD,
-	                               &file_stripe_width);
+	                               &file_stripe_width,
+	                               &optimum_access_size);
 	if (result) goto cleanup;
+	telemetry_record(&cksm_info->Telemetry, TELEMETRY_OPEN, cksm_info->StartTime);
+
+	cksm_info->BlockSize = blocksize_select(Config,
+	                                        CommandInfo->pathname,
+	                                        cksm_info->BlockSize,
+	                                        cksm_info->RangeLength,
+	                                        file_stripe_width,
+	                                        optimum_access_size);
 
 	result = cksm_start_markers(&cksm_info->Marker, Operation);
 	if (result) goto cleanup;
 
+	result = hasher_start(&cksm_info->Hasher,
+	                      checksum_update,
+	                      cksm_info->Checksum,
+	                      CommandInfo->cksm_offset,
+	                      cksm_info->BlockSize,
+	                      CKSM_HASH_QUEUE_DEPTH,
+	                      Config->BufferPool);
+	if (result) goto cleanup;
+
 
 	/*
 	 * Setup PIO
 	 */
+	/* The checksum needs the blocks in order, so use a single participant. */
 	result = pio_start(HPSS_PIO_READ,
 	                   cksm_info->FileFD,
 	                   file_stripe_width,
+	                   1,
 	                   cksm_info->BlockSize,
+	                   Config->BufferPool,
+	                   &cksm_info->Telemetry,
 	                   CommandInfo->cksm_offset,
 	                   cksm_info->RangeLength,
 	                   cksm_pio_callout,
@@ -359,12 +405,17 @@ cleanup:
 	{
 		if (cksm_info)
 		{
+			if (cksm_info->Hasher)
+				hasher_finish(cksm_info->Hasher, 1, NULL, NULL);
+			cksm_stop_markers(cksm_info->Marker);
+			telemetry_finish(&cksm_info->Telemetry, CommandInfo->pathname, result);
 			if (cksm_info->FileFD != -1)
 				hpss_Close(cksm_info->FileFD);
 			if (cksm_info->Pathname)
 				free(cksm_info->Pathname);
 			free(cksm_info);
 		}
+		checksum_destroy(checksum);
 		Callback(Operation, result, NULL);
 	}
 }
@@ -379,7 +430,10 @@ cleanup:
  * /hpss/user/cksum/filesize                                     1
  */
 globus_result_t
-cksm_set_checksum(char * Pathname, config_t * Config, char * Checksum)
+cksm_set_checksum(char       * Pathname,
+                  config_t   * Config,
+                  const char * Algorithm,
+                  char       * Checksum)
 {
 	int                  retval = 0;
 	char                 filesize_buf[32];
@@ -393,7 +447,8 @@ cksm_set_checksum(char * Pathname, config_t * Config, char * Checksum)
 
 	if (Config->UDAChecksumSupport)
 	{
-		result = stat_object(Pathname, &gfs_stat);
+		/* Not from the attribute cache; the size must match what was summed. */
+		result = stat_object(Pathname, &gfs_stat, NULL);
 		if (result != GLOBUS_SUCCESS)
 			return result;
 
@@ -405,7 +460,7 @@ cksm_set_checksum(char * Pathname, config_t * Config, char * Checksum)
 		attr_list.Pair = user_attrs;
 
 		attr_list.Pair[0].Key   = "/hpss/user/cksum/algorithm";
-		attr_list.Pair[0].Value = "md5";
+		attr_list.Pair[0].Value = (char *)Algorithm;
 		attr_list.Pair[1].Key   = "/hpss/user/cksum/checksum";
 		attr_list.Pair[1].Value = Checksum;
 		attr_list.Pair[2].Key   = "/hpss/user/cksum/lastupdate";
@@ -427,8 +482,15 @@ cksm_set_checksum(char * Pathname, config_t * Config, char * Checksum)
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * Returns the valid checksum stored in the UDAs and its algorithm, or NULLs
+ * if there is none.
+ */
 globus_result_t
-checksum_get_file_sum(char * Pathname, config_t * Config, char ** ChecksumString)
+cksm_get_checksum(char     *  Pathname,
+                  config_t *  Config,
+                  char     ** Algorithm,
+                  char     ** ChecksumString)
 {
 	int                  retval = 0;
 	char               * tmp    = NULL;
@@ -439,8 +501,9 @@ checksum_get_file_sum(char * Pathname, config_t * Config, char ** ChecksumString
 	hpss_userattr_t      user_attrs[3];
 	hpss_userattr_list_t attr_list;
 
-	GlobusGFSName(checksum_get_file_sum);
+	GlobusGFSName(cksm_get_checksum);
 
+	*Algorithm      = NULL;
 	*ChecksumString = NULL;
 
 	if (Config->UDAChecksumSupport)
@@ -467,16 +530,6 @@ checksum_get_file_sum(char * Pathname, config_t * Config, char ** ChecksumString
 			return GlobusGFSErrorSystemError("hpss_UserAttrGetAttrs", -retval);
 		}
 
-		tmp = hpss_ChompXMLHeader(algorithm, NULL);
-		if (!tmp)
-			return GLOBUS_SUCCESS;
-
-		strcpy(value, tmp);
-		free(tmp);
-
-		if (strcmp(value, "md5") != 0)
-			return GLOBUS_SUCCESS;
-
 		tmp = hpss_ChompXMLHeader(state, NULL);
 		if (!tmp)
 			return GLOBUS_SUCCESS;
@@ -487,11 +540,60 @@ checksum_get_file_sum(char * Pathname, config_t * Config, char ** ChecksumString
 		if (strcmp(value, "Valid") != 0)
 			return GLOBUS_SUCCESS;
 
+		*Algorithm = hpss_ChompXMLHeader(algorithm, NULL);
+		if (!*Algorithm)
+			return GLOBUS_SUCCESS;
+
 		*ChecksumString = hpss_ChompXMLHeader(checksum, NULL);
+		if (!*ChecksumString)
+		{
+			free(*Algorithm);
+			*Algorithm = NULL;
+		}
 	}
     return GLOBUS_SUCCESS;
 }
 
+globus_result_t
+checksum_get_file_sum(char       *  Pathname,
+                      config_t   *  Config,
+                      const char *  Algorithm,
+                      char       ** ChecksumString)
+{
+	char          * algorithm = NULL;
+	globus_result_t result    = GLOBUS_SUCCESS;
+
+	GlobusGFSName(checksum_get_file_sum);
+
+	result = cksm_get_checksum(Pathname, Config, &algorithm, ChecksumString);
+	if (result || !algorithm)
+		return result;
+
+	/* A sum in another algorithm is no use to this request. */
+	if (strcasecmp(algorithm, Algorithm) != 0)
+	{
+		free(*ChecksumString);
+		*ChecksumString = NULL;
+	}
+
+	free(algorithm);
+	return GLOBUS_SUCCESS;
+}
+
+/* A transfer of the whole file, from the start, sees the file's checksum. */
+int
+cksm_is_whole_file(globus_gfs_transfer_info_t * TransferInfo)
+{
+	globus_off_t offset;
+	globus_off_t length;
+
+	if (globus_range_list_size(TransferInfo->range_list) != 1)
+		return 0;
+
+	globus_range_list_at(TransferInfo->range_list, 0, &offset, &length);
+	return (offset == 0 && length == -1);
+}
+
 globus_result_t
 cksm_clear_checksum(char * Pathname, config_t * Config)
 {
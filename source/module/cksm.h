@@ -41,11 +41,6 @@
 #ifndef HPSS_DSI_CKSM_H
 #define HPSS_DSI_CKSM_H
 
-/*
- * System includes
- */
-#include <openssl/md5.h>
-
 /*
  * Globus includes
  */
@@ -61,6 +56,9 @@
  */
 #include "commands.h"
 #include "config.h"
+#include "hasher.h"
+#include "checksum.h"
+#include "telemetry.h"
 
 typedef struct {
 	pthread_mutex_t          Lock;
@@ -75,14 +73,21 @@ typedef struct {
 	config_t                  * Config;
 	char                      * Pathname;
 	commands_callback           Callback;
-	MD5_CTX                     MD5Context;
+	checksum_t                * Checksum;
 	globus_result_t             Result;
 	int                         FileFD;
 	globus_size_t               BlockSize;
 	globus_off_t                RangeLength;
+	globus_off_t                TotalLength;
 	cksm_marker_t             * Marker;
+	hasher_t                  * Hasher;
+	uint64_t                    StartTime;
+	telemetry_t                 Telemetry;
 } cksm_info_t;
 
+/* Blocks queued for hashing before PIO waits on the hasher. */
+#define CKSM_HASH_QUEUE_DEPTH 4
+
 void
 cksm(globus_gfs_operation_t      Operation,
      globus_gfs_command_info_t * CommandInfo,
@@ -90,10 +95,25 @@ cksm(globus_gfs_operation_t      Operation,
      commands_callback           Callback);
 
 globus_result_t
-cksm_set_checksum(char * Pathname, config_t * Config, char * Checksum);
+cksm_set_checksum(char       * Pathname,
+                  config_t   * Config,
+                  const char * Algorithm,
+                  char       * Checksum);
 
 globus_result_t
-checksum_get_file_sum(char * Pathname, config_t * Config, char ** ChecksumString);
+checksum_get_file_sum(char       *  Pathname,
+                      config_t   *  Config,
+                      const char *  Algorithm,
+                      char       ** ChecksumString);
+
+globus_result_t
+cksm_get_checksum(char     *  Pathname,
+                  config_t *  Config,
+                  char     ** Algorithm,
+                  char     ** ChecksumString);
+
+int
+cksm_is_whole_file(globus_gfs_transfer_info_t * TransferInfo);
 
 globus_result_t
 cksm_clear_checksum(char * Pathname, config_t * Config);
@@ -63,6 +63,7 @@
 #include "config.h"
 #include "stage.h"
 #include "cksm.h"
+#include "checksum.h"
 
 globus_result_t
 commands_init(globus_gfs_operation_t Operation)
@@ -82,6 +83,21 @@ commands_init(globus_gfs_operation_t Operation)
 	if (result != GLOBUS_SUCCESS)
 		return GlobusGFSErrorWrapFailed("Failed to add custom 'SITE STAGE' command", result);
 
+	result = globus_gridftp_server_add_command(
+	                 Operation,
+	                 "SITE BATCHSTAGE",
+	                 GLOBUS_GFS_HPSS_CMD_SITE_BATCHSTAGE,
+	                 4,
+	                 4,
+	                 "SITE BATCHSTAGE <sp> timeout <sp> manifest",
+	                 GLOBUS_TRUE,
+	                 GFS_ACL_ACTION_READ);
+
+	if (result != GLOBUS_SUCCESS)
+		return GlobusGFSErrorWrapFailed("Failed to add custom 'SITE BATCHSTAGE' command", result);
+
+	checksum_advertise(Operation);
+
 	return GLOBUS_SUCCESS;
 }
 
@@ -311,6 +327,36 @@ commands_truncate(globus_gfs_operation_t      Operation,
 	Callback(Operation, result, NULL);
 }
 
+/*
+ * Drops cached attributes of whatever the command changes. Commands within
+ * a session run one at a time, so doing this first is enough.
+ */
+static void
+commands_invalidate(globus_gfs_command_info_t * CommandInfo, config_t * Config)
+{
+	switch (CommandInfo->command)
+	{
+	case GLOBUS_GFS_CMD_MKD:
+	case GLOBUS_GFS_CMD_DELE:
+	case GLOBUS_GFS_CMD_SITE_CHMOD:
+	case GLOBUS_GFS_CMD_SITE_CHGRP:
+	case GLOBUS_GFS_CMD_SITE_UTIME:
+	case GLOBUS_GFS_CMD_SITE_SYMLINK:
+		attrcache_invalidate(Config->AttrCache, CommandInfo->pathname);
+		break;
+	case GLOBUS_GFS_CMD_TRNC:
+		attrcache_invalidate(Config->AttrCache, CommandInfo->from_pathname);
+		break;
+	case GLOBUS_GFS_CMD_RMD:
+	case GLOBUS_GFS_CMD_RNTO:
+		/* Paths below the directory change too. */
+		attrcache_invalidate_all(Config->AttrCache);
+		break;
+	default:
+		break;
+	}
+}
+
 void
 commands_run(globus_gfs_operation_t      Operation,
              globus_gfs_command_info_t * CommandInfo,
@@ -319,6 +365,8 @@ commands_run(globus_gfs_operation_t      Operation,
 {
 	GlobusGFSName(commands_run);
 
+	commands_invalidate(CommandInfo, Config);
+
 	switch (CommandInfo->command)
 	{
 	case GLOBUS_GFS_CMD_MKD:
@@ -355,6 +403,9 @@ commands_run(globus_gfs_operation_t      Operation,
 	case GLOBUS_GFS_HPSS_CMD_SITE_STAGE:
 		stage(Operation, CommandInfo, Callback);
 		break;
+	case GLOBUS_GFS_HPSS_CMD_SITE_BATCHSTAGE:
+		stage_batch(Operation, CommandInfo, Config, Callback);
+		break;
 	case GLOBUS_GFS_CMD_TRNC:
 		commands_truncate(Operation, CommandInfo, Callback);
 		break;
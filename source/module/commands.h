@@ -53,6 +53,7 @@
 
 enum {
 	GLOBUS_GFS_HPSS_CMD_SITE_STAGE = GLOBUS_GFS_MIN_CUSTOM_CMD,
+	GLOBUS_GFS_HPSS_CMD_SITE_BATCHSTAGE,
 };
 
 globus_result_t
@@ -43,6 +43,7 @@
  * System includes
  */
 #include <stdlib.h>
+#include <limits.h>
 
 /*
  * Globus includes
@@ -59,6 +60,8 @@
  * Local includes
  */
 #include "config.h"
+#include "checksum.h"
+#include "listing.h"
 
 /*
  * The config file search order is:
@@ -218,6 +221,136 @@ config_get_bool_value(char * Value, int ValueLength)
 	return 0;
 }
 
+globus_result_t
+config_get_int_value(char * Value, int ValueLength, int * IntValue)
+{
+	char * value = NULL;
+	char * end   = NULL;
+	long   tmp   = 0;
+
+	GlobusGFSName(config_get_int_value);
+
+	value = strndup(Value, ValueLength);
+	if (!value)
+		return GlobusGFSErrorMemory("config value");
+
+	errno = 0;
+	tmp = strtol(value, &end, 10);
+	if (errno || end == value || *end != '\0' || tmp < 0 || tmp > INT_MAX)
+	{
+		free(value);
+		return GlobusGFSErrorGeneric("Illegal integer value");
+	}
+
+	free(value);
+	*IntValue = tmp;
+	return GLOBUS_SUCCESS;
+}
+
+static globus_result_t
+config_get_allocator_value(char * Value, int ValueLength, int * Allocator)
+{
+	GlobusGFSName(config_get_allocator_value);
+
+	if (ValueLength == strlen("malloc") && strncasecmp(Value, "malloc", ValueLength) == 0)
+		*Allocator = POOL_ALLOC_MALLOC;
+	else if (ValueLength == strlen("hugepage") && strncasecmp(Value, "hugepage", ValueLength) == 0)
+		*Allocator = POOL_ALLOC_HUGEPAGE;
+	else if (ValueLength == strlen("hugepage1g") && strncasecmp(Value, "hugepage1g", ValueLength) == 0)
+		*Allocator = POOL_ALLOC_HUGEPAGE_1G;
+	else
+		return GlobusGFSErrorGeneric("Illegal buffer allocator");
+
+	return GLOBUS_SUCCESS;
+}
+
+static globus_result_t
+config_get_verify_value(char * Value, int ValueLength, int * Verify)
+{
+	GlobusGFSName(config_get_verify_value);
+
+	if (ValueLength == strlen("off") && strncasecmp(Value, "off", ValueLength) == 0)
+		*Verify = RETR_VERIFY_OFF;
+	else if (ValueLength == strlen("flag") && strncasecmp(Value, "flag", ValueLength) == 0)
+		*Verify = RETR_VERIFY_FLAG;
+	else if (ValueLength == strlen("fail") && strncasecmp(Value, "fail", ValueLength) == 0)
+		*Verify = RETR_VERIFY_FAIL;
+	else
+		return GlobusGFSErrorGeneric("Illegal checksum verification mode");
+
+	return GLOBUS_SUCCESS;
+}
+
+/* 'off' leaves Algorithm NULL. */
+static globus_result_t
+config_get_checksum_value(char * Value, int ValueLength, char ** Algorithm)
+{
+	globus_result_t result   = GLOBUS_SUCCESS;
+	checksum_t    * checksum = NULL;
+
+	GlobusGFSName(config_get_checksum_value);
+
+	if (*Algorithm)
+		free(*Algorithm);
+	*Algorithm = NULL;
+
+	if (ValueLength == strlen("off") && strncasecmp(Value, "off", ValueLength) == 0)
+		return GLOBUS_SUCCESS;
+
+	*Algorithm = strndup(Value, ValueLength);
+	if (!*Algorithm)
+		return GlobusGFSErrorMemory("checksum algorithm");
+
+	/* Catch typos now rather than on the first transfer. */
+	result = checksum_init(&checksum, *Algorithm);
+	if (result)
+	{
+		free(*Algorithm);
+		*Algorithm = NULL;
+		return result;
+	}
+	checksum_destroy(checksum);
+
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Sizes may be given in bytes or with a K, M or G suffix (powers of 2).
+ */
+globus_result_t
+config_get_size_value(char * Value, int ValueLength, size_t * SizeValue)
+{
+	char               * value = NULL;
+	char               * end   = NULL;
+	unsigned long long   tmp   = 0;
+	unsigned long long   scale = 1;
+
+	GlobusGFSName(config_get_size_value);
+
+	value = strndup(Value, ValueLength);
+	if (!value)
+		return GlobusGFSErrorMemory("config value");
+
+	errno = 0;
+	tmp = strtoull(value, &end, 10);
+	switch (toupper(*end))
+	{
+	case 'K': scale = 1ULL << 10; end++; break;
+	case 'M': scale = 1ULL << 20; end++; break;
+	case 'G': scale = 1ULL << 30; end++; break;
+	}
+
+	if (errno || end == value || *end != '\0' || tmp > (SIZE_MAX / scale))
+	{
+		free(value);
+		return GlobusGFSErrorGeneric("Illegal size value");
+	}
+
+	free(value);
+	*SizeValue = tmp * scale;
+	return GLOBUS_SUCCESS;
+}
+
 static globus_result_t
 config_parse_file(char     * ConfigFilePath,
                   config_t * Config)
@@ -287,6 +420,150 @@ config_parse_file(char     * ConfigFilePath,
 		} else if (key_length == strlen("UDAChecksumSupport") && strncasecmp(key, "UDAChecksumSupport", key_length) == 0)
 		{
 			Config->UDAChecksumSupport = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("RetrZeroCopy") && strncasecmp(key, "RetrZeroCopy", key_length) == 0)
+		{
+			Config->RetrZeroCopy = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("StorZeroCopy") && strncasecmp(key, "StorZeroCopy", key_length) == 0)
+		{
+			Config->StorZeroCopy = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("ClientStripeWidth") && strncasecmp(key, "ClientStripeWidth", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->ClientStripeWidth);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("PioMaxThreads") && strncasecmp(key, "PioMaxThreads", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->PioMaxThreads);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("ListingPrefetch") && strncasecmp(key, "ListingPrefetch", key_length) == 0)
+		{
+			Config->ListingPrefetch = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("ListingBatchSize") && strncasecmp(key, "ListingBatchSize", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->ListingBatchSize);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("ListingSymlinkTargets") && strncasecmp(key, "ListingSymlinkTargets", key_length) == 0)
+		{
+			Config->ListingSymlinkTargets = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("ListingSymlinkThreads") && strncasecmp(key, "ListingSymlinkThreads", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->ListingSymlinkThreads);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("AttrCacheTTL") && strncasecmp(key, "AttrCacheTTL", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->AttrCacheTTL);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("RetrStageFirst") && strncasecmp(key, "RetrStageFirst", key_length) == 0)
+		{
+			Config->RetrStageFirst = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("BatchStageConcurrency") && strncasecmp(key, "BatchStageConcurrency", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->BatchStageConcurrency);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("RetrPipelineDepth") && strncasecmp(key, "RetrPipelineDepth", key_length) == 0)
+		{
+			result = config_get_int_value(value, value_length, &Config->RetrPipelineDepth);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("BufferPoolSize") && strncasecmp(key, "BufferPoolSize", key_length) == 0)
+		{
+			result = config_get_size_value(value, value_length, &Config->BufferPoolSize);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("BufferAllocator") && strncasecmp(key, "BufferAllocator", key_length) == 0)
+		{
+			result = config_get_allocator_value(value, value_length, &Config->BufferAllocator);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("BufferNumaBind") && strncasecmp(key, "BufferNumaBind", key_length) == 0)
+		{
+			Config->BufferNumaBind = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("InlineChecksum") && strncasecmp(key, "InlineChecksum", key_length) == 0)
+		{
+			result = config_get_checksum_value(value, value_length, &Config->InlineChecksum);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("RetrVerifyChecksum") && strncasecmp(key, "RetrVerifyChecksum", key_length) == 0)
+		{
+			result = config_get_verify_value(value, value_length, &Config->RetrVerifyChecksum);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("AdaptiveBlockSize") && strncasecmp(key, "AdaptiveBlockSize", key_length) == 0)
+		{
+			Config->AdaptiveBlockSize = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("MinBlockSize") && strncasecmp(key, "MinBlockSize", key_length) == 0)
+		{
+			result = config_get_size_value(value, value_length, &Config->MinBlockSize);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("MaxBlockSize") && strncasecmp(key, "MaxBlockSize", key_length) == 0)
+		{
+			result = config_get_size_value(value, value_length, &Config->MaxBlockSize);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("SmallFileThreshold") && strncasecmp(key, "SmallFileThreshold", key_length) == 0)
+		{
+			result = config_get_size_value(value, value_length, &Config->SmallFileThreshold);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
+		} else if (key_length == strlen("StorSparseWrites") && strncasecmp(key, "StorSparseWrites", key_length) == 0)
+		{
+			Config->StorSparseWrites = config_get_bool_value(value, value_length);
+		} else if (key_length == strlen("StorReorderWindow") && strncasecmp(key, "StorReorderWindow", key_length) == 0)
+		{
+			result = config_get_size_value(value, value_length, &Config->StorReorderWindow);
+			if (result)
+			{
+				result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+				goto cleanup;
+			}
 		} else
 		{
 			result = GlobusGFSErrorWrapFailed("Parsing config options", GlobusGFSErrorGeneric(buffer));
@@ -359,12 +636,37 @@ config_init(config_t ** Config)
 		goto cleanup;
 	}
 	memset(*Config, 0, sizeof(config_t));
+	(*Config)->ClientStripeWidth     = 1;
+	(*Config)->MinBlockSize          = 64 * 1024;
+	(*Config)->MaxBlockSize          = 64 * 1024 * 1024;
+	(*Config)->ListingBatchSize      = LISTING_FIRST_BATCH;
+	(*Config)->ListingSymlinkTargets = 1;
+	(*Config)->ListingSymlinkThreads = 1;
+	(*Config)->BatchStageConcurrency = 8;
 
 	result = config_parse_file(config_file_path, *Config);
 	if (result)
 		goto cleanup;
 
+	if ((*Config)->ListingBatchSize < 1)
+		(*Config)->ListingBatchSize = 1;
+	if ((*Config)->ListingSymlinkThreads < 1)
+		(*Config)->ListingSymlinkThreads = 1;
+	if ((*Config)->BatchStageConcurrency < 1)
+		(*Config)->BatchStageConcurrency = 1;
+
 	result = config_process_env();
+	if (result)
+		goto cleanup;
+
+	result = pool_init(&(*Config)->BufferPool,
+	                   (*Config)->BufferPoolSize,
+	                   (*Config)->BufferAllocator,
+	                   (*Config)->BufferNumaBind);
+	if (result)
+		goto cleanup;
+
+	result = attrcache_init(&(*Config)->AttrCache, (*Config)->AttrCacheTTL);
 
 cleanup:
 	if (config_file_path)
@@ -388,6 +690,11 @@ config_destroy(config_t * Config)
 			free(Config->AuthenticationMech);
 		if (Config->Authenticator)
 			free(Config->Authenticator);
+		if (Config->InlineChecksum)
+			free(Config->InlineChecksum);
+
+		pool_destroy(Config->BufferPool);
+		attrcache_destroy(Config->AttrCache);
 
 		free(Config);
 	}
@@ -46,14 +46,54 @@
  */
 #include <globus_gridftp_server.h>
 
+/*
+ * Local includes
+ */
+#include "pool.h"
+#include "attrcache.h"
+
 #define DEFAULT_CONFIG_FILE   "/var/hpss/etc/gridftp.conf"
 
+/* What RETR does when the data doesn't match the stored checksum. */
+typedef enum {
+	RETR_VERIFY_OFF,
+	RETR_VERIFY_FLAG, // Log it
+	RETR_VERIFY_FAIL, // Log it and fail the transfer
+} retr_verify_t;
+
 typedef struct config {
 	char * LoginName;
 	char * AuthenticationMech;
 	char * Authenticator;
 	int    QuotaSupport;
 	int    UDAChecksumSupport;
+	int    RetrZeroCopy;
+	int    StorZeroCopy;
+	int    ClientStripeWidth;
+	int    RetrPipelineDepth;
+	size_t BufferPoolSize;
+	int    BufferAllocator; // pool_allocator_t
+	int    BufferNumaBind;
+	char * InlineChecksum;  // Algorithm, NULL if off
+	int    RetrVerifyChecksum; // retr_verify_t
+	size_t StorReorderWindow;
+	int    StorSparseWrites;
+	int    AdaptiveBlockSize;
+	size_t MinBlockSize;
+	size_t MaxBlockSize;
+	size_t SmallFileThreshold;
+	int    PioMaxThreads;   // 0 is unlimited
+	int    ListingPrefetch;
+	int    ListingBatchSize;
+	int    ListingSymlinkTargets;
+	int    ListingSymlinkThreads;
+	int    AttrCacheTTL;    // Seconds, 0 is off
+	int    BatchStageConcurrency;
+	int    RetrStageFirst;
+
+	/* Session state, not read from the config file. */
+	pool_t      * BufferPool;
+	attrcache_t * AttrCache;
 } config_t;
 
 globus_result_t
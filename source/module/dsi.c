@@ -42,6 +42,7 @@
 /*
  * System includes
  */
+#include <pthread.h>
 #include <string.h>
 
 /*
@@ -64,6 +65,47 @@
 #include "stat.h"
 #include "stor.h"
 #include "retr.h"
+#include "workers.h"
+#include "listing.h"
+
+extern globus_gfs_storage_iface_t hpss_local_dsi_iface;
+
+/*
+ * Whether STOR takes data out of order is part of the interface descriptor,
+ * which is process wide. The first session decides it from its config and
+ * every later session must agree; turning StorReorderWindow or
+ * StorSparseWrites on or off needs a server restart.
+ */
+static pthread_mutex_t _gDescriptorLock = PTHREAD_MUTEX_INITIALIZER;
+static int             _gDescriptorSet  = 0;
+static int             _gUnorderedData  = 0;
+
+static globus_result_t
+dsi_set_descriptor(config_t * Config)
+{
+	int unordered = (Config->StorReorderWindow || Config->StorSparseWrites);
+
+	GlobusGFSName(dsi_set_descriptor);
+
+	pthread_mutex_lock(&_gDescriptorLock);
+	{
+		if (!_gDescriptorSet)
+		{
+			_gDescriptorSet = 1;
+			_gUnorderedData = unordered;
+#ifdef GLOBUS_GFS_DSI_DESCRIPTOR_REQUIRES_ORDERED_DATA
+			if (unordered)
+				hpss_local_dsi_iface.descriptor &= ~GLOBUS_GFS_DSI_DESCRIPTOR_REQUIRES_ORDERED_DATA;
+#endif
+		}
+	}
+	pthread_mutex_unlock(&_gDescriptorLock);
+
+	if (unordered != _gUnorderedData)
+		return GlobusGFSErrorGeneric("StorReorderWindow and StorSparseWrites can not be "
+		                             "turned on or off without restarting the server");
+	return GLOBUS_SUCCESS;
+}
 
 void
 dsi_init(globus_gfs_operation_t      Operation,
@@ -83,6 +125,13 @@ dsi_init(globus_gfs_operation_t      Operation,
 	if (result)
 		goto cleanup;
 
+	/* STOR can reorder blocks itself; let parallel streams deliver out of order. */
+	result = dsi_set_descriptor(config);
+	if (result)
+		goto cleanup;
+
+	workers_set_max_threads(config->PioMaxThreads);
+
 	/* Now authenticate. */
 	result = authenticate(config->LoginName,
 	                      config->AuthenticationMech,
@@ -159,7 +208,15 @@ dsi_send(globus_gfs_operation_t       Operation,
 
 	GlobusGFSName(dsi_send);
 
-	retr(Operation, TransferInfo);
+	retr(Operation, TransferInfo, UserArg);
+}
+
+/* Only RETR asks for transfer events, while it waits on a stage. */
+static void
+dsi_trev(globus_gfs_event_info_t * EventInfo,
+         void                    * UserArg)
+{
+	retr_transfer_event(EventInfo);
 }
 
 static void
@@ -196,16 +253,20 @@ dsi_stat(globus_gfs_operation_t   Operation,
 {
 	GlobusGFSName(dsi_stat);
 
-	globus_result_t   result = GLOBUS_SUCCESS;
-	globus_gfs_stat_t gfs_stat;
+	globus_result_t     result  = GLOBUS_SUCCESS;
+	config_t          * config  = Arg;
+	listing_t         * listing = NULL;
+	globus_gfs_stat_t * gfs_stat_array = NULL;
+	ns_DirEntry_t     * dir_entries    = NULL;
+	globus_gfs_stat_t   gfs_stat;
 
 	switch (StatInfo->use_symlink_info)
 	{
 	case 0:
-		result = stat_object(StatInfo->pathname, &gfs_stat);
+		result = stat_object(StatInfo->pathname, &gfs_stat, config->AttrCache);
 		break;
 	default:
-		result = stat_link(StatInfo->pathname, &gfs_stat);
+		result = stat_link(StatInfo->pathname, &gfs_stat, config->AttrCache);
 		break;
 	}
 
@@ -218,7 +279,6 @@ dsi_stat(globus_gfs_operation_t   Operation,
 
 	stat_destroy(&gfs_stat);
 
-#define STAT_ENTRIES_PER_REPLY 200
 	/*
 	 * Directory listing.
 	 */
@@ -233,31 +293,48 @@ dsi_stat(globus_gfs_operation_t   Operation,
 		return;
 	}
 
-	uint64_t offset = 0;
-	uint32_t end    = FALSE;
-	while (!end)
+	gfs_stat_array = malloc(sizeof(globus_gfs_stat_t) * config->ListingBatchSize);
+	if (!gfs_stat_array)
+	{
+		result = GlobusGFSErrorMemory("globus_gfs_stat_t array");
+		globus_gridftp_server_finished_stat(Operation, result, NULL, 0);
+		return;
+	}
+
+	result = listing_open(&listing,
+	                      &dir_attrs.ObjectHandle,
+	                      config->ListingBatchSize,
+	                      config->ListingPrefetch);
+
+	uint32_t end = FALSE;
+	while (!result && !end)
 	{
-		globus_gfs_stat_t gfs_stat_array[STAT_ENTRIES_PER_REPLY];
 		uint32_t count_out;
 
-		result = stat_directory_entries(&dir_attrs.ObjectHandle,
-		                                offset,
-		                                STAT_ENTRIES_PER_REPLY,
-		                                &end,
-		                                &offset,
-		                                gfs_stat_array,
-		                                &count_out);
+		result = listing_next(listing, &dir_entries, &count_out, &end);
+		if (result)
+			break;
+
+		result = stat_translate_dir_entries(&dir_attrs.ObjectHandle,
+		                                    dir_entries,
+		                                    count_out,
+		                                    gfs_stat_array,
+		                                    listing->Names,
+		                                    config->ListingSymlinkTargets ?
+		                                        config->ListingSymlinkThreads : 0);
 		if (result)
 			break;
 
+		/* The names go back to the arena on the next listing_next(). */
 		globus_gridftp_server_finished_stat_partial(Operation,
 		                                            GLOBUS_SUCCESS,
 		                                            gfs_stat_array,
 		                                            count_out);
-
-		stat_destroy_array(gfs_stat_array, count_out);
 	}
 
+	listing_close(listing);
+	free(gfs_stat_array);
+
 	globus_gridftp_server_finished_stat(Operation, result, NULL, 0);
 }
 
@@ -278,7 +355,7 @@ globus_gfs_storage_iface_t hpss_local_dsi_iface =
 	NULL,         /* list_func        */
 	dsi_send,     /* send_func        */
 	dsi_recv,     /* recv_func        */
-	NULL,         /* trev_func        */
+	dsi_trev,     /* trev_func        */
 	NULL,         /* active_func      */
 	NULL,         /* passive_func     */
 	NULL,         /* data_destroy     */
@@ -0,0 +1,325 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "hasher.h"
+#include "telemetry.h"
+
+/* Not called locked; Release may take the submitter's locks. */
+static void
+hasher_release_block(hasher_t * Hasher, hasher_block_t * Block)
+{
+	if (Block->Release)
+		Block->Release(Block->ReleaseArg, Block->Buffer);
+	else
+		pool_free(Hasher->Pool, Block->Buffer, Hasher->BlockSize);
+	free(Block);
+}
+
+/* Called locked. */
+static void
+hasher_enqueue(hasher_t * Hasher, hasher_block_t * Block)
+{
+	hasher_block_t ** entry = NULL;
+
+	for (entry = &Hasher->Queue; *entry && (*entry)->Offset < Block->Offset; entry = &(*entry)->Next);
+	Block->Next = *entry;
+	*entry      = Block;
+	Hasher->QueueCnt++;
+	pthread_cond_broadcast(&Hasher->Cond);
+}
+
+static void *
+hasher_thread(void * Arg)
+{
+	int              rc      = 0;
+	uint64_t         start   = 0;
+	hasher_t       * hasher  = Arg;
+	hasher_block_t * block   = NULL;
+	hasher_block_t * dropped = NULL;
+
+	GlobusGFSName(hasher_thread);
+
+	pthread_mutex_lock(&hasher->Lock);
+	while (1)
+	{
+		if (hasher->Abort || hasher->Result)
+		{
+			/* Drop anything queued; submitters will see the result. */
+			dropped          = hasher->Queue;
+			hasher->Queue    = NULL;
+			hasher->QueueCnt = 0;
+			pthread_cond_broadcast(&hasher->Cond);
+
+			if (dropped)
+			{
+				pthread_mutex_unlock(&hasher->Lock);
+				while ((block = dropped))
+				{
+					dropped = block->Next;
+					hasher_release_block(hasher, block);
+				}
+				pthread_mutex_lock(&hasher->Lock);
+				continue;
+			}
+
+			if (hasher->Finish)
+				break;
+			pthread_cond_wait(&hasher->Cond, &hasher->Lock);
+			continue;
+		}
+
+		block = hasher->Queue;
+		if (!block || block->Offset != hasher->NextOffset)
+		{
+			if (hasher->Finish)
+			{
+				if (block)
+					hasher->Result = GlobusGFSErrorGeneric("Checksum data is incomplete");
+				else
+					break;
+				continue;
+			}
+			pthread_cond_wait(&hasher->Cond, &hasher->Lock);
+			continue;
+		}
+
+		hasher->Queue = block->Next;
+		hasher->QueueCnt--;
+		hasher->NextOffset += block->Length;
+		pthread_cond_broadcast(&hasher->Cond);
+
+		pthread_mutex_unlock(&hasher->Lock);
+		{
+			start = telemetry_now();
+			rc = hasher->Update(hasher->Context, block->Buffer, block->Length);
+			hasher->HashTime += telemetry_now() - start;
+			hasher_release_block(hasher, block);
+		}
+		pthread_mutex_lock(&hasher->Lock);
+
+		if (rc && !hasher->Result)
+			hasher->Result = GlobusGFSErrorGeneric("Checksum update failed");
+	}
+	pthread_mutex_unlock(&hasher->Lock);
+
+	return NULL;
+}
+
+globus_result_t
+hasher_start(hasher_t     ** Hasher,
+             hasher_update_t Update,
+             void          * Context,
+             uint64_t        Offset,
+             uint32_t        BlockSize,
+             int             MaxQueued,
+             pool_t        * Pool)
+{
+	int rc = 0;
+
+	GlobusGFSName(hasher_start);
+
+	*Hasher = malloc(sizeof(hasher_t));
+	if (!*Hasher)
+		return GlobusGFSErrorMemory("hasher_t");
+
+	memset(*Hasher, 0, sizeof(hasher_t));
+	pthread_mutex_init(&(*Hasher)->Lock, NULL);
+	pthread_cond_init(&(*Hasher)->Cond, NULL);
+	(*Hasher)->Update     = Update;
+	(*Hasher)->Context    = Context;
+	(*Hasher)->NextOffset = Offset;
+	(*Hasher)->BlockSize  = BlockSize;
+	(*Hasher)->MaxQueued  = MaxQueued < 1 ? 1 : MaxQueued;
+	(*Hasher)->Pool       = Pool;
+
+	rc = pthread_create(&(*Hasher)->ThreadID, NULL, hasher_thread, *Hasher);
+	if (rc)
+	{
+		pthread_cond_destroy(&(*Hasher)->Cond);
+		pthread_mutex_destroy(&(*Hasher)->Lock);
+		free(*Hasher);
+		*Hasher = NULL;
+		return GlobusGFSErrorSystemError("pthread_create", rc);
+	}
+
+	return GLOBUS_SUCCESS;
+}
+
+globus_result_t
+hasher_submit(hasher_t   * Hasher,
+              const char * Buffer,
+              uint32_t     Length,
+              uint64_t     Offset)
+{
+	uint64_t          start  = 0;
+	char            * buffer = NULL;
+	hasher_block_t  * block  = NULL;
+	globus_result_t   result = GLOBUS_SUCCESS;
+
+	GlobusGFSName(hasher_submit);
+
+	block = malloc(sizeof(hasher_block_t));
+	buffer = pool_alloc(Hasher->Pool, Hasher->BlockSize);
+	if (!block || !buffer)
+	{
+		if (block) free(block);
+		if (buffer) pool_free(Hasher->Pool, buffer, Hasher->BlockSize);
+		return GlobusGFSErrorMemory("hasher_block_t");
+	}
+
+	memcpy(buffer, Buffer, Length);
+	block->Buffer  = buffer;
+	block->Length  = Length;
+	block->Offset  = Offset;
+	block->Release = NULL;
+
+	pthread_mutex_lock(&Hasher->Lock);
+	{
+		start = telemetry_now();
+		while (!Hasher->Result &&
+		       Hasher->QueueCnt >= Hasher->MaxQueued &&
+		       Offset != Hasher->NextOffset)
+		{
+			pthread_cond_wait(&Hasher->Cond, &Hasher->Lock);
+		}
+		Hasher->StallTime += telemetry_now() - start;
+
+		result = Hasher->Result;
+		if (!result)
+		{
+			hasher_enqueue(Hasher, block);
+			block = NULL;
+		}
+	}
+	pthread_mutex_unlock(&Hasher->Lock);
+
+	if (block)
+		hasher_release_block(Hasher, block);
+
+	return result;
+}
+
+globus_result_t
+hasher_submit_shared(hasher_t       * Hasher,
+                     char           * Buffer,
+                     uint32_t         Length,
+                     uint64_t         Offset,
+                     hasher_release_t Release,
+                     void           * ReleaseArg)
+{
+	hasher_block_t  * block  = NULL;
+	globus_result_t   result = GLOBUS_SUCCESS;
+
+	GlobusGFSName(hasher_submit_shared);
+
+	block = malloc(sizeof(hasher_block_t));
+	if (!block)
+		return GlobusGFSErrorMemory("hasher_block_t");
+
+	block->Buffer     = Buffer;
+	block->Length     = Length;
+	block->Offset     = Offset;
+	block->Release    = Release;
+	block->ReleaseArg = ReleaseArg;
+
+	pthread_mutex_lock(&Hasher->Lock);
+	{
+		result = Hasher->Result;
+		if (!result)
+			hasher_enqueue(Hasher, block);
+	}
+	pthread_mutex_unlock(&Hasher->Lock);
+
+	if (result)
+		free(block);
+
+	return result;
+}
+
+void
+hasher_abort(hasher_t * Hasher)
+{
+	pthread_mutex_lock(&Hasher->Lock);
+	{
+		Hasher->Abort = 1;
+		pthread_cond_broadcast(&Hasher->Cond);
+	}
+	pthread_mutex_unlock(&Hasher->Lock);
+}
+
+globus_result_t
+hasher_finish(hasher_t * Hasher,
+              int        Abort,
+              uint64_t * HashTime,
+              uint64_t * StallTime)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	pthread_mutex_lock(&Hasher->Lock);
+	{
+		Hasher->Finish = 1;
+		Hasher->Abort  = Abort;
+		pthread_cond_broadcast(&Hasher->Cond);
+	}
+	pthread_mutex_unlock(&Hasher->Lock);
+
+	pthread_join(Hasher->ThreadID, NULL);
+
+	result = Hasher->Result;
+	if (HashTime)
+		*HashTime = Hasher->HashTime;
+	if (StallTime)
+		*StallTime = Hasher->StallTime;
+
+	pthread_cond_destroy(&Hasher->Cond);
+	pthread_mutex_destroy(&Hasher->Lock);
+	free(Hasher);
+
+	return result;
+}
@@ -0,0 +1,161 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_HASHER_H
+#define HPSS_DSI_HASHER_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "pool.h"
+
+/*
+ * The hasher runs checksum updates on its own thread so that PIO can keep
+ * reading while the previous blocks are hashed. Blocks may be submitted in
+ * any order; they are queued by offset and hashed in order. Submitters
+ * block once MaxQueued blocks are waiting, except for the block the hasher
+ * needs next.
+ */
+
+/* Returns 0 on success. */
+typedef int (*hasher_update_t) (void       * Context,
+                                const char * Buffer,
+                                uint32_t     Length);
+
+/* Hands a shared buffer back once the hasher is done with it. */
+typedef void (*hasher_release_t) (void * Arg, char * Buffer);
+
+typedef struct hasher_block {
+	char                * Buffer;
+	uint32_t              Length;
+	uint64_t              Offset;
+	hasher_release_t      Release;    // NULL if Buffer is the hasher's copy
+	void                * ReleaseArg;
+	struct hasher_block * Next;
+} hasher_block_t;
+
+typedef struct {
+	pthread_mutex_t   Lock;
+	pthread_cond_t    Cond;
+	pthread_t         ThreadID;
+
+	hasher_update_t   Update;
+	void            * Context;
+	pool_t          * Pool;
+	uint32_t          BlockSize;
+	int               MaxQueued;
+
+	uint64_t          NextOffset; // Next offset to hash
+	hasher_block_t  * Queue;      // Sorted by offset
+	int               QueueCnt;
+	int               Finish;
+	int               Abort;
+	globus_result_t   Result;
+
+	/* Timing, in microseconds. */
+	uint64_t          HashTime;  // Spent in Update()
+	uint64_t          StallTime; // Submitters waited on a full queue
+} hasher_t;
+
+globus_result_t
+hasher_start(hasher_t     ** Hasher,
+             hasher_update_t Update,
+             void          * Context,
+             uint64_t        Offset,
+             uint32_t        BlockSize,
+             int             MaxQueued,
+             pool_t        * Pool);
+
+/*
+ * Hands a copy of the block to the hasher. PIO read buffers are still
+ * HPSS's once the callout returns, so they can not be kept.
+ */
+globus_result_t
+hasher_submit(hasher_t   * Hasher,
+              const char * Buffer,
+              uint32_t     Length,
+              uint64_t     Offset);
+
+/*
+ * Hands a block to the hasher without copying it. Buffer must not change
+ * until Release(ReleaseArg, Buffer) is called, from the hasher's thread or
+ * from hasher_finish(), without hasher locks held. Never waits on a full
+ * queue; the caller bounds how many blocks it shares. On failure, the
+ * caller keeps the buffer and Release is not called.
+ */
+globus_result_t
+hasher_submit_shared(hasher_t       * Hasher,
+                     char           * Buffer,
+                     uint32_t         Length,
+                     uint64_t         Offset,
+                     hasher_release_t Release,
+                     void           * ReleaseArg);
+
+/*
+ * Discards the queued blocks and any submitted later, releasing shared ones
+ * from the hasher's thread. For callers that must get a shared buffer back
+ * before the transfer ends. hasher_finish() must still be called.
+ */
+void
+hasher_abort(hasher_t * Hasher);
+
+/*
+ * Waits for the queued blocks to be hashed (or discards them if Abort is
+ * set), stops the thread and frees the hasher. Timings are returned before
+ * the hasher is freed if the pointers are not NULL.
+ */
+globus_result_t
+hasher_finish(hasher_t * Hasher,
+              int        Abort,
+              uint64_t * HashTime,
+              uint64_t * StallTime);
+
+#endif /* HPSS_DSI_HASHER_H */
@@ -0,0 +1,266 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "listing.h"
+#include "telemetry.h"
+
+/* Reads the next batch into Batch. Called unlocked. */
+static void
+listing_read_batch(listing_t * Listing, listing_batch_t * Batch)
+{
+	int      retval = 0;
+	uint64_t start  = telemetry_now();
+
+	GlobusGFSName(listing_read_batch);
+
+	Batch->Count  = 0;
+	Batch->End    = FALSE;
+	Batch->Result = GLOBUS_SUCCESS;
+
+	retval = hpss_ReadAttrsHandle(&Listing->ObjHandle,
+	                              Listing->Offset,
+	                              NULL,
+	                              sizeof(ns_DirEntry_t)*Listing->BatchSize,
+	                              TRUE,
+	                              &Batch->End,
+	                              &Listing->Offset,
+	                              Batch->Entries);
+	if (retval < 0)
+		Batch->Result = GlobusGFSErrorSystemError("hpss_ReadAttrsHandle", -retval);
+	else
+		Batch->Count = retval;
+
+	if (Batch->Result || Batch->End)
+		Listing->Done = 1;
+
+	Listing->BatchSize *= 2;
+	if (Listing->BatchSize > Listing->MaxBatchSize)
+		Listing->BatchSize = Listing->MaxBatchSize;
+
+	Listing->ReadTime += telemetry_now() - start;
+}
+
+static void *
+listing_thread(void * Arg)
+{
+	int         slot    = 0;
+	listing_t * listing = Arg;
+
+	pthread_mutex_lock(&listing->Lock);
+	while (!listing->Done)
+	{
+		while (!listing->Stop && (listing->Batches[slot].Ready || listing->Held == slot))
+		{
+			pthread_cond_wait(&listing->Cond, &listing->Lock);
+		}
+		if (listing->Stop)
+			break;
+
+		/* Offset and BatchSize are only touched by this thread now. */
+		pthread_mutex_unlock(&listing->Lock);
+		{
+			listing_read_batch(listing, &listing->Batches[slot]);
+		}
+		pthread_mutex_lock(&listing->Lock);
+
+		listing->Batches[slot].Ready = 1;
+		pthread_cond_broadcast(&listing->Cond);
+		slot ^= 1;
+	}
+	pthread_mutex_unlock(&listing->Lock);
+
+	return NULL;
+}
+
+globus_result_t
+listing_open(listing_t      ** Listing,
+             ns_ObjHandle_t  * ObjHandle,
+             uint32_t          MaxBatchSize,
+             int               Prefetch)
+{
+	int             i      = 0;
+	int             rc     = 0;
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	GlobusGFSName(listing_open);
+
+	if (MaxBatchSize < 1)
+		MaxBatchSize = 1;
+
+	*Listing = malloc(sizeof(listing_t));
+	if (!*Listing)
+		return GlobusGFSErrorMemory("listing_t");
+
+	memset(*Listing, 0, sizeof(listing_t));
+	pthread_mutex_init(&(*Listing)->Lock, NULL);
+	pthread_cond_init(&(*Listing)->Cond, NULL);
+	(*Listing)->ObjHandle    = *ObjHandle;
+	(*Listing)->MaxBatchSize = MaxBatchSize;
+	(*Listing)->BatchSize    = MaxBatchSize < LISTING_FIRST_BATCH ? MaxBatchSize
+	                                                              : LISTING_FIRST_BATCH;
+	(*Listing)->Held         = -1;
+
+	result = arena_init(&(*Listing)->Names);
+	if (result)
+		goto cleanup;
+
+	/* Without prefetch, only the first batch is used. */
+	for (i = 0; i < (Prefetch ? 2 : 1); i++)
+	{
+		(*Listing)->Batches[i].Entries = malloc(sizeof(ns_DirEntry_t) * MaxBatchSize);
+		if (!(*Listing)->Batches[i].Entries)
+		{
+			result = GlobusGFSErrorMemory("ns_DirEntry_t array");
+			goto cleanup;
+		}
+	}
+
+	if (Prefetch)
+	{
+		rc = pthread_create(&(*Listing)->ThreadID, NULL, listing_thread, *Listing);
+		if (rc)
+		{
+			result = GlobusGFSErrorSystemError("pthread_create", rc);
+			goto cleanup;
+		}
+		(*Listing)->Prefetch = 1;
+	}
+
+cleanup:
+	if (result)
+	{
+		listing_close(*Listing);
+		*Listing = NULL;
+	}
+	return result;
+}
+
+globus_result_t
+listing_next(listing_t      * Listing,
+             ns_DirEntry_t ** Entries,
+             uint32_t       * Count,
+             uint32_t       * End)
+{
+	uint64_t          start = 0;
+	listing_batch_t * batch = NULL;
+
+	arena_reset(Listing->Names);
+
+	if (!Listing->Prefetch)
+	{
+		batch = &Listing->Batches[0];
+		listing_read_batch(Listing, batch);
+	} else
+	{
+		pthread_mutex_lock(&Listing->Lock);
+		{
+			/* Hand the batch we gave out last time back to the reader. */
+			if (Listing->Held >= 0)
+			{
+				Listing->Batches[Listing->Held].Ready = 0;
+				Listing->Held = -1;
+				pthread_cond_broadcast(&Listing->Cond);
+			}
+
+			batch = &Listing->Batches[Listing->Next];
+			if (!batch->Ready)
+			{
+				start = telemetry_now();
+				while (!batch->Ready)
+				{
+					pthread_cond_wait(&Listing->Cond, &Listing->Lock);
+				}
+				Listing->WaitTime += telemetry_now() - start;
+			}
+
+			Listing->Held = Listing->Next;
+			Listing->Next ^= 1;
+		}
+		pthread_mutex_unlock(&Listing->Lock);
+	}
+
+	*Entries = batch->Entries;
+	*Count   = batch->Count;
+	*End     = batch->End;
+	return batch->Result;
+}
+
+void
+listing_close(listing_t * Listing)
+{
+	if (!Listing)
+		return;
+
+	if (Listing->Prefetch)
+	{
+		pthread_mutex_lock(&Listing->Lock);
+		{
+			Listing->Stop = 1;
+			pthread_cond_broadcast(&Listing->Cond);
+		}
+		pthread_mutex_unlock(&Listing->Lock);
+
+		pthread_join(Listing->ThreadID, NULL);
+
+		globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+		    "Listing: %llu ms reading attributes, %llu ms waiting on reads\n",
+		    (unsigned long long)Listing->ReadTime / 1000,
+		    (unsigned long long)Listing->WaitTime / 1000);
+	}
+
+	arena_destroy(Listing->Names);
+	if (Listing->Batches[0].Entries)
+		free(Listing->Batches[0].Entries);
+	if (Listing->Batches[1].Entries)
+		free(Listing->Batches[1].Entries);
+
+	pthread_cond_destroy(&Listing->Cond);
+	pthread_mutex_destroy(&Listing->Lock);
+	free(Listing);
+}
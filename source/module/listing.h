@@ -0,0 +1,127 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_LISTING_H
+#define HPSS_DSI_LISTING_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * HPSS includes
+ */
+#include <hpss_api.h>
+
+/*
+ * Local includes
+ */
+#include "arena.h"
+
+/*
+ * Reads a directory in batches of entries with attributes. With prefetch,
+ * a helper thread reads the next batch while the caller translates and
+ * sends the current one. Batches start small so the first reply goes out
+ * quickly and double up to MaxBatchSize.
+ *
+ * Entry buffers are allocated once per listing. Names is an arena for
+ * strings made from the current batch; it is reset with each batch.
+ */
+
+#define LISTING_FIRST_BATCH 200
+
+typedef struct {
+	ns_DirEntry_t * Entries;  // MaxBatchSize entries
+	uint32_t        Count;
+	uint32_t        End;
+	globus_result_t Result;
+	int             Ready;
+} listing_batch_t;
+
+typedef struct {
+	pthread_mutex_t Lock;
+	pthread_cond_t  Cond;
+	pthread_t       ThreadID;
+	int             Prefetch;
+
+	ns_ObjHandle_t  ObjHandle;
+	uint64_t        Offset;       // Next offset to read
+	uint32_t        BatchSize;    // Entries in the next read
+	uint32_t        MaxBatchSize;
+	int             Done;         // Read the last batch or failed
+	int             Stop;
+
+	listing_batch_t Batches[2];
+	int             Next;         // Batch the caller gets next
+	int             Held;         // Batch the caller has, -1 if none
+	arena_t       * Names;
+
+	/* Timing, in microseconds. */
+	uint64_t        ReadTime;     // In hpss_ReadAttrsHandle()
+	uint64_t        WaitTime;     // Caller waited for a batch
+} listing_t;
+
+globus_result_t
+listing_open(listing_t      ** Listing,
+             ns_ObjHandle_t  * ObjHandle,
+             uint32_t          MaxBatchSize,
+             int               Prefetch);
+
+/*
+ * Returns the next batch. The entries, and anything allocated from Names,
+ * stay valid until the next call to listing_next() or listing_close(). Don't call again once *End is set.
+ */
+globus_result_t
+listing_next(listing_t      * Listing,
+             ns_DirEntry_t ** Entries,
+             uint32_t       * Count,
+             uint32_t       * End);
+
+void
+listing_close(listing_t * Listing);
+
+#endif /* HPSS_DSI_LISTING_H */
@@ -42,54 +42,75 @@
 /*
  * System includes
  */
+#include <assert.h>
 #include <pthread.h>
+#include <string.h>
 
 /*
  * Local includes
  */
 #include "pio.h"
 #include "markers.h"
+#include "workers.h"
 
 globus_result_t
 pio_launch_detached(void * (*ThreadEntry)(void * Arg), void * Arg)
 {
-	int             rc      = 0;
-	int             initted = 0;
-	pthread_t       thread;
-	pthread_attr_t  attr;
-	globus_result_t result = GLOBUS_SUCCESS;
+	globus_result_t   result = GLOBUS_SUCCESS;
+	workers_group_t * group  = NULL;
 
 	GlobusGFSName(pio_launch_detached);
 
 	/*
-	 * Launch a detached thread.
+	 * Run it on a pool worker.
 	 */
-	if ((rc = pthread_attr_init(&attr)) || !(initted = 1) ||
-	    (rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) ||
-	    (rc = pthread_create(&thread, &attr, ThreadEntry, Arg)))
+	result = workers_group_init(&group);
+	if (result)
+		return result;
+
+	result = workers_group_add(group, ThreadEntry, Arg);
+	if (result)
 	{
-		result = GlobusGFSErrorSystemError("Launching get object thread", rc);
+		workers_group_destroy(group);
+		return result;
 	}
-	if (initted) pthread_attr_destroy(&attr);
-	return result;
+
+	return workers_submit(group);
 }
 
-globus_result_t
-pio_launch_attached(void *   (* ThreadEntry)(void * Arg),
-                    void      * Arg,
-                    pthread_t * ThreadID)
+/*
+ * Called by each role as it finishes. The last one out completes the
+ * transfer.
+ */
+static void
+pio_role_done(pio_t * Pio)
 {
-	int rc = 0;
+	int             i         = 0;
+	int             remaining = 0;
+	globus_result_t result    = GLOBUS_SUCCESS;
 
-	GlobusGFSName(pio_launch_attached);
+	pthread_mutex_lock(&Pio->Lock);
+	{
+		remaining = --Pio->RunningCnt;
+	}
+	pthread_mutex_unlock(&Pio->Lock);
 
-	/*
-	 * Launch a detached thread.
-	 */
-	rc = pthread_create(ThreadID, NULL, ThreadEntry, Arg);
-	if (rc)
-		return GlobusGFSErrorSystemError("Launching get object thread", rc);
-	return GLOBUS_SUCCESS;
+	if (remaining > 0)
+		return;
+
+	for (i = 0; i < Pio->ClntStripeWidth; i++)
+	{
+		if (!result) result = Pio->Participants[i].Result;
+		/* After any exchanges, this is the buffer the participant owns. */
+		pool_free(Pio->Pool, Pio->Participants[i].Buffer, Pio->BlockSize);
+	}
+
+	if (!result) result = Pio->CoordinatorResult;
+
+	Pio->XferCmpltCB(result, Pio->UserArg);
+	pthread_mutex_destroy(&Pio->Lock);
+	free(Pio->Participants);
+	free(Pio);
 }
 
 void *
@@ -141,6 +162,7 @@ pio_coordinator_thread(void * Arg)
 	if (rc != 0 && rc != PIO_END_TRANSFER && pio->CoordinatorResult == GLOBUS_SUCCESS)
 		pio->CoordinatorResult = GlobusGFSErrorSystemError("hpss_PIOEnd", -rc);
 
+	pio_role_done(pio);
 	return NULL;
 }
 
@@ -150,73 +172,71 @@ pio_register_callback(void     *  UserArg,
                       uint32_t *  Length,
                       void     ** Buffer)
 {
-	pio_t * pio = UserArg;
-	/*
-	 * On STOR, this buffer comes up NULL the first time. On RETR,
-	 * it is not NULL but it isn't safe to exchange either.
-	 */
-	if (!*Buffer) *Buffer = pio->Buffer;
-	return pio->DataCO(*Buffer, Length, Offset, pio->UserArg);
-}
-
-void *
-pio_thread(void * Arg)
-{
-	int               rc     = 0;
-	pio_t           * pio    = Arg;
-	globus_result_t   result = GLOBUS_SUCCESS;
-	int               coord_launched  = 0;
-	int               safe_to_end_pio = 0;
-	pthread_t         thread_id;
-	char            * buffer = NULL;
+	int                 rc          = 0;
+	char              * buffer      = NULL;
+	char              * held        = NULL;
+	pio_participant_t * participant = UserArg;
+	pio_t             * pio         = participant->Pio;
 
-	GlobusGFSName(pio_thread);
+	/* HPSS has had the buffer since the last callout returned. */
+	telemetry_record(pio->Telemetry, TELEMETRY_HPSS, participant->CalloutReturn);
 
-	buffer = malloc(pio->BlockSize);
-	if (!buffer)
+	if (pio->Operation == HPSS_PIO_READ)
 	{
-		result = GlobusGFSErrorMemory("pio buffer");
-		goto cleanup;
+		/*
+		 * On RETR, this buffer is not NULL but it isn't safe to exchange
+		 * either; the callout only reads it.
+		 */
+		buffer = *Buffer;
+		rc = pio->DataCO(&buffer, Length, Offset, pio->UserArg);
+assert(buffer == *Buffer);
+	} else
+	{
+		/*
+		 * On STOR, this buffer comes up NULL the first time. The callout
+		 * fills participant->Buffer, which it may exchange. If HPSS hands
+		 * us any other buffer, the block is copied into it.
+		 */
+		held   = participant->Buffer;
+		buffer = held;
+		rc = pio->DataCO(&buffer, Length, Offset, pio->UserArg);
+		participant->Buffer = buffer;
+
+		if (!*Buffer || *Buffer == held)
+			*Buffer = buffer;
+		else if (rc == 0)
+			memcpy(*Buffer, buffer, *Length);
 	}
 
-	/*
-	 * Save buffer into pio; the write callback shows up without
-	 * a buffer right after hpss_PIOExecute().
-	 */
-	pio->Buffer = buffer;
+	participant->CalloutReturn = telemetry_now();
+	return rc;
+}
 
-	result = pio_launch_attached(pio_coordinator_thread, pio, &thread_id);
-	if (result)
-		goto cleanup;
-	coord_launched = 1;
+void *
+pio_participant_thread(void * Arg)
+{
+	int                 rc          = 0;
+	pio_participant_t * participant = Arg;
+	pio_t             * pio         = participant->Pio;
 
-	rc = hpss_PIORegister(0,
+	GlobusGFSName(pio_participant_thread);
+
+	participant->CalloutReturn = telemetry_now();
+	rc = hpss_PIORegister(participant->Index,
 	                      NULL, /* DataNetSockAddr */
-	                      buffer,
+	                      participant->Buffer,
 	                      pio->BlockSize,
-	                      pio->ParticipantSG,
+	                      participant->ParticipantSG,
 	                      pio_register_callback,
-	                      pio);
+	                      participant);
 	if (rc != 0 && rc != PIO_END_TRANSFER)
-		result = GlobusGFSErrorSystemError("hpss_PIORegister", -rc);
-	safe_to_end_pio = 1;
-
-cleanup:
-	if (safe_to_end_pio)
-	{
-		rc = hpss_PIOEnd(pio->ParticipantSG);
-		if (rc != 0 && rc != PIO_END_TRANSFER && !result)
-			result = GlobusGFSErrorSystemError("hpss_PIOEnd", -rc);
-	}
+		participant->Result = GlobusGFSErrorSystemError("hpss_PIORegister", -rc);
 
-	if (coord_launched) pthread_join(thread_id, NULL);
-	if (buffer) free(buffer);
-
-	if (!result) result = pio->CoordinatorResult;
-
-	pio->XferCmpltCB(result, pio->UserArg);
-	free(pio);
+	rc = hpss_PIOEnd(participant->ParticipantSG);
+	if (rc != 0 && rc != PIO_END_TRANSFER && !participant->Result)
+		participant->Result = GlobusGFSErrorSystemError("hpss_PIOEnd", -rc);
 
+	pio_role_done(pio);
 	return NULL;
 }
 
@@ -224,7 +244,10 @@ globus_result_t
 pio_start(hpss_pio_operation_t           PioOpType,
           int                            FD,
           int                            FileStripeWidth,
+          int                            ClntStripeWidth,
           uint32_t                       BlockSize,
+          pool_t                       * Pool,
+          telemetry_t                  * Telemetry,
           globus_off_t                   Offset,
           globus_off_t                   Length,
           pio_data_callout               DataCO,
@@ -234,10 +257,13 @@ pio_start(hpss_pio_operation_t           PioOpType,
 {
 	globus_result_t   result = GLOBUS_SUCCESS;
 	pio_t           * pio    = NULL;
+	workers_group_t * group  = NULL;
 	hpss_pio_params_t pio_params;
 	void            * group_buffer  = NULL;
 	unsigned int      buffer_length = 0;
 	int               eot           = 0;
+	int               i             = 0;
+	uint64_t          setup_start   = 0;
 
 	GlobusGFSName(pio_start);
 
@@ -262,8 +288,12 @@ pio_start(hpss_pio_operation_t           PioOpType,
 		goto cleanup;
 	}
 	memset(pio, 0, sizeof(pio_t));
+	pthread_mutex_init(&pio->Lock, NULL);
+	pio->Operation     = PioOpType;
 	pio->FD            = FD;
 	pio->BlockSize     = BlockSize;
+	pio->Pool          = Pool;
+	pio->Telemetry     = Telemetry;
 	pio->InitialOffset = Offset;
 	pio->InitialLength = Length;
 	pio->DataCO        = DataCO;
@@ -271,17 +301,33 @@ pio_start(hpss_pio_operation_t           PioOpType,
 	pio->XferCmpltCB   = XferCmpltCB;
 	pio->UserArg       = UserArg;
 
+	/* There is nothing to gain from more participants than file stripes. */
+	if (ClntStripeWidth > FileStripeWidth)
+		ClntStripeWidth = FileStripeWidth;
+	if (ClntStripeWidth < 1)
+		ClntStripeWidth = 1;
+	pio->ClntStripeWidth = ClntStripeWidth;
+
+	pio->Participants = malloc(sizeof(pio_participant_t) * ClntStripeWidth);
+	if (!pio->Participants)
+	{
+		result = GlobusGFSErrorMemory("pio_participant_t");
+		goto cleanup;
+	}
+	memset(pio->Participants, 0, sizeof(pio_participant_t) * ClntStripeWidth);
+
 	/*
 	 * Don't use HPSS_PIO_HANDLE_GAP, it's bugged in HPSS 7.4.
 	 */
 	pio_params.Operation       = PioOpType;
-	pio_params.ClntStripeWidth = 1;
+	pio_params.ClntStripeWidth = pio->ClntStripeWidth;
 	pio_params.BlockSize       = BlockSize;
 	pio_params.FileStripeWidth = FileStripeWidth;
 	pio_params.IOTimeOutSecs   = 0;
 	pio_params.Transport       = HPSS_PIO_MVR_SELECT;
 	pio_params.Options         = 0;
 
+	setup_start = telemetry_now();
 	int retval = hpss_PIOStart(&pio_params, &pio->CoordinatorSG);
 	if (retval != 0)
 	{
@@ -296,20 +342,79 @@ pio_start(hpss_pio_operation_t           PioOpType,
 		goto cleanup;
 	}
 
-	retval = hpss_PIOImportGrp(group_buffer, buffer_length, &pio->ParticipantSG);
-	if (retval != 0)
+	/* Export once, import once per participant. */
+	for (i = 0; i < pio->ClntStripeWidth; i++)
+	{
+		pio->Participants[i].Pio   = pio;
+		pio->Participants[i].Index = i;
+
+		retval = hpss_PIOImportGrp(group_buffer,
+		                           buffer_length,
+		                           &pio->Participants[i].ParticipantSG);
+		if (retval != 0)
+		{
+			result = GlobusGFSErrorSystemError("hpss_PIOImportGrp", -retval);
+			goto cleanup;
+		}
+	}
+	telemetry_record(pio->Telemetry, TELEMETRY_PIO_START, setup_start);
+
+	/*
+	 * Save the buffers into the participants; the write callback shows
+	 * up without a buffer right after hpss_PIOExecute().
+	 */
+	for (i = 0; i < pio->ClntStripeWidth; i++)
 	{
-		result = GlobusGFSErrorSystemError("hpss_PIOImportGrp", -retval);
+		pio->Participants[i].Buffer = pool_alloc(pio->Pool, pio->BlockSize);
+		if (!pio->Participants[i].Buffer)
+		{
+			result = GlobusGFSErrorMemory("pio buffer");
+			goto cleanup;
+		}
+	}
+
+	/*
+	 * The coordinator and the participants wait on each other so they are
+	 * submitted as one group; the pool starts all of them or none.
+	 */
+	result = workers_group_init(&group);
+	if (result)
+		goto cleanup;
+
+	result = workers_group_add(group, pio_coordinator_thread, pio);
+	for (i = 0; !result && i < pio->ClntStripeWidth; i++)
+	{
+		result = workers_group_add(group,
+		                           pio_participant_thread,
+		                           &pio->Participants[i]);
+	}
+	if (result)
+	{
+		workers_group_destroy(group);
 		goto cleanup;
 	}
 
-	result = pio_launch_detached(pio_thread, pio);
+	pio->RunningCnt = group->TaskCnt;
+	result = workers_submit(group);
 
 	if (!result) return result;
 
 cleanup:
 	/* Can not clean up the stripe groups without crashing. */
-	if (pio) free(pio);
+	if (pio)
+	{
+		if (pio->Participants)
+		{
+			for (i = 0; i < pio->ClntStripeWidth; i++)
+			{
+				if (pio->Participants[i].Buffer)
+					pool_free(pio->Pool, pio->Participants[i].Buffer, pio->BlockSize);
+			}
+			free(pio->Participants);
+		}
+		pthread_mutex_destroy(&pio->Lock);
+		free(pio);
+	}
 	return result;
 }
 
@@ -56,10 +56,24 @@
  */
 #include <hpss_api.h>
 
+/*
+ * Local includes
+ */
+#include "pool.h"
+#include "telemetry.h"
+
 #define PIO_END_TRANSFER 0xDEADBEEF
 
+/*
+ * On HPSS_PIO_WRITE, the callout may exchange *Buffer for another
+ * buffer of BlockSize bytes. PIO uses the new buffer for the next
+ * block and the callout takes ownership of the old one. Buffers must
+ * come from the pool given to pio_start() since PIO releases whichever
+ * buffer it holds at the end. On HPSS_PIO_READ, *Buffer belongs to
+ * HPSS and must not be exchanged or kept.
+ */
 typedef int
-(*pio_data_callout)(char     * Buffer,
+(*pio_data_callout)(char    ** Buffer, /* IN / OUT */
                     uint32_t * Length, /* IN / OUT */
                     uint64_t   Offset,
                     void     * CallbackArg);
@@ -85,9 +99,25 @@ typedef void
 //	PIO_OP_CKSM,
 //} pio_op_type_t;
 
+struct pio;
+
+/*
+ * One per client stripe. Each participant imports the stripe group,
+ * registers its own buffer and calls the data callout from its own
+ * worker thread, so callouts must be safe to call concurrently.
+ */
 typedef struct {
+	struct pio    * Pio;
+	int             Index;
+	char          * Buffer;
+	globus_result_t Result;
+	hpss_pio_grp_t  ParticipantSG;
+	uint64_t        CalloutReturn; // When HPSS got the last block back
+} pio_participant_t;
+
+typedef struct pio {
+	hpss_pio_operation_t Operation;
 	int           FD;
-	char        * Buffer;
 	uint32_t      BlockSize;
 	uint64_t      InitialOffset;
 	uint64_t      InitialLength;
@@ -99,15 +129,31 @@ typedef struct {
 
 	globus_result_t CoordinatorResult;
 	hpss_pio_grp_t  CoordinatorSG;
-	hpss_pio_grp_t  ParticipantSG;
+
+	int                 ClntStripeWidth;
+	pio_participant_t * Participants;
+	pool_t            * Pool;
+	telemetry_t       * Telemetry;
+
+	/* Roles still running. The last to finish completes the transfer. */
+	pthread_mutex_t     Lock;
+	int                 RunningCnt;
 } pio_t;
     
-/* Don't call for zero-length transfers. */
+/*
+ * Don't call for zero-length transfers. ClntStripeWidth is the number
+ * of participant threads; callouts that need ordered data should pass 1.
+ * PIO records its setup time and the time HPSS spends on each block in
+ * Telemetry.
+ */
 globus_result_t
 pio_start(hpss_pio_operation_t           PioOpType,
           int                            FD,
           int                            FileStripeWidth,
+          int                            ClntStripeWidth,
           uint32_t                       BlockSize,
+          pool_t                       * Pool,
+          telemetry_t                  * Telemetry,
           globus_off_t                   Offset,
           globus_off_t                   Length,
           pio_data_callout               Callout,
@@ -118,4 +164,7 @@ pio_start(hpss_pio_operation_t           PioOpType,
 globus_result_t
 pio_end();
 
+globus_result_t
+pio_launch_detached(void * (*ThreadEntry)(void * Arg), void * Arg);
+
 #endif /* HPSS_DSI_PIO_H */
@@ -0,0 +1,462 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+/*
+ * Local includes
+ */
+#include "pool.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+/* From <numaif.h>; we make the syscall directly to avoid needing libnuma. */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+/*
+ * Cached buffers carry their free list link and the node they were
+ * bound to in their first bytes.
+ */
+typedef struct pool_link {
+	struct pool_link * Next;
+	int                Node;
+} pool_link_t;
+
+globus_result_t
+pool_init(pool_t        ** Pool,
+          size_t           MaxBytes,
+          pool_allocator_t Allocator,
+          int              NumaBind)
+{
+	GlobusGFSName(pool_init);
+
+	*Pool = malloc(sizeof(pool_t));
+	if (!*Pool)
+		return GlobusGFSErrorMemory("pool_t");
+
+	memset(*Pool, 0, sizeof(pool_t));
+	pthread_mutex_init(&(*Pool)->Lock, NULL);
+	(*Pool)->MaxBytes  = MaxBytes;
+	(*Pool)->Allocator = Allocator;
+	(*Pool)->NumaBind  = NumaBind;
+
+	return GLOBUS_SUCCESS;
+}
+
+/* NUMA node of the calling thread, or -1 if unknown. */
+static int
+pool_current_node()
+{
+#ifdef SYS_getcpu
+	unsigned int cpu  = 0;
+	unsigned int node = 0;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+		return node;
+#endif
+	return -1;
+}
+
+static pool_node_t **
+pool_node_bucket(pool_t * Pool, void * Buffer)
+{
+	return &Pool->Nodes[((uintptr_t)Buffer >> 12) % POOL_NODE_BUCKETS];
+}
+
+/* Called locked. Node Buffer was bound to when mapped, or -1. */
+static int
+pool_buffer_node(pool_t * Pool, void * Buffer)
+{
+	pool_node_t * entry = *pool_node_bucket(Pool, Buffer);
+
+	while (entry && entry->Buffer != Buffer)
+		entry = entry->Next;
+	return entry ? entry->Node : -1;
+}
+
+static void
+pool_record_node(pool_t * Pool, void * Buffer, int Node)
+{
+	pool_node_t  * entry  = malloc(sizeof(pool_node_t));
+	pool_node_t ** bucket = NULL;
+
+	/* Without it, the buffer is just not preferred by any node. */
+	if (!entry)
+		return;
+
+	pthread_mutex_lock(&Pool->Lock);
+	{
+		bucket        = pool_node_bucket(Pool, Buffer);
+		entry->Buffer = Buffer;
+		entry->Node   = Node;
+		entry->Next   = *bucket;
+		*bucket       = entry;
+	}
+	pthread_mutex_unlock(&Pool->Lock);
+}
+
+static void
+pool_forget_node(pool_t * Pool, void * Buffer)
+{
+	pool_node_t ** entry = NULL;
+	pool_node_t  * found = NULL;
+
+	pthread_mutex_lock(&Pool->Lock);
+	{
+		for (entry = pool_node_bucket(Pool, Buffer); *entry; entry = &(*entry)->Next)
+		{
+			if ((*entry)->Buffer == Buffer)
+			{
+				found  = *entry;
+				*entry = found->Next;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&Pool->Lock);
+
+	if (found)
+		free(found);
+}
+
+/*
+ * Buffers are mapped, rather than malloc'ed, in whole pages. Huge page
+ * mappings are whole huge pages already; see pool_uses_hugetlb().
+ */
+static size_t
+pool_map_length(pool_t * Pool, size_t Size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+
+	return (Size + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+ * Only sizes that are whole huge pages get them. Rounding others up would
+ * spend a reserved 1GB page on each 64MB block, or a 2MB page on each small
+ * file buffer, and soon use up the reserve; they get transparent huge pages.
+ */
+static int
+pool_uses_hugetlb(pool_t * Pool, size_t Size)
+{
+	switch (Pool->Allocator)
+	{
+	case POOL_ALLOC_HUGEPAGE:
+		return (Size % (2UL << 20)) == 0;
+	case POOL_ALLOC_HUGEPAGE_1G:
+		return (Size % (1UL << 30)) == 0;
+	case POOL_ALLOC_MALLOC:
+		break;
+	}
+	return 0;
+}
+
+static int
+pool_uses_mmap(pool_t * Pool)
+{
+	/* mbind() needs page aligned memory, which malloc() won't promise. */
+	return (Pool && (Pool->Allocator != POOL_ALLOC_MALLOC || Pool->NumaBind));
+}
+
+/*
+ * Maps a new buffer. Pages are bound to the caller's node before they are
+ * first touched so they are placed there, not wherever PIO touches them.
+ */
+static void *
+pool_map_buffer(pool_t * Pool, size_t Size)
+{
+	void          * buffer = MAP_FAILED;
+	size_t          length = pool_map_length(Pool, Size);
+	int             flags  = MAP_PRIVATE|MAP_ANONYMOUS;
+	int             node   = -1;
+	int             huge   = pool_uses_hugetlb(Pool, Size);
+	int             warn   = 0;
+	int             error  = 0;
+	unsigned long   node_mask;
+
+	if (huge)
+	{
+		pthread_mutex_lock(&Pool->Lock);
+		{
+			huge = !Pool->HugeTLBFailed;
+		}
+		pthread_mutex_unlock(&Pool->Lock);
+	}
+
+	if (huge)
+	{
+		buffer = mmap(NULL,
+		              length,
+		              PROT_READ|PROT_WRITE,
+		              flags|MAP_HUGETLB|(Pool->Allocator == POOL_ALLOC_HUGEPAGE_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+		              -1,
+		              0);
+
+		if (buffer == MAP_FAILED)
+		{
+			/* Usually means no huge pages are reserved; don't keep trying. */
+			error = errno;
+			pthread_mutex_lock(&Pool->Lock);
+			{
+				warn = !Pool->HugeTLBFailed;
+				Pool->HugeTLBFailed = 1;
+			}
+			pthread_mutex_unlock(&Pool->Lock);
+
+			if (warn)
+				globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+				                       "HPSS DSI: MAP_HUGETLB failed (%s), falling back to "
+				                       "transparent huge pages\n",
+				                       strerror(error));
+		}
+	}
+
+	if (buffer == MAP_FAILED)
+	{
+		buffer = mmap(NULL, length, PROT_READ|PROT_WRITE, flags, -1, 0);
+		if (buffer == MAP_FAILED)
+			return NULL;
+
+#ifdef MADV_HUGEPAGE
+		if (Pool->Allocator != POOL_ALLOC_MALLOC)
+			madvise(buffer, length, MADV_HUGEPAGE);
+#endif
+	}
+
+#ifdef SYS_mbind
+	if (Pool->NumaBind && (node = pool_current_node()) >= 0 && node < (8 * sizeof(node_mask)))
+	{
+		node_mask = 1UL << node;
+		/* Failure only costs us locality. */
+		if (syscall(SYS_mbind, buffer, length, MPOL_PREFERRED, &node_mask, 8 * sizeof(node_mask), 0) == 0)
+			pool_record_node(Pool, buffer, node);
+	}
+#endif
+
+	return buffer;
+}
+
+static void *
+pool_sys_alloc(pool_t * Pool, size_t Size)
+{
+	if (pool_uses_mmap(Pool))
+		return pool_map_buffer(Pool, Size);
+	return malloc(Size);
+}
+
+static void
+pool_sys_free(pool_t * Pool, void * Buffer, size_t Size)
+{
+	if (Pool && Pool->NumaBind)
+		pool_forget_node(Pool, Buffer);
+
+	if (pool_uses_mmap(Pool))
+		munmap(Buffer, pool_map_length(Pool, Size));
+	else
+		free(Buffer);
+}
+
+/* Called locked. Finds the class for Size, optionally claiming an empty one. */
+static pool_class_t *
+pool_find_class(pool_t * Pool, size_t Size, int Create)
+{
+	int i;
+	pool_class_t * unused = NULL;
+
+	for (i = 0; i < POOL_MAX_CLASSES; i++)
+	{
+		if (Pool->Classes[i].Size == Size)
+			return &Pool->Classes[i];
+
+		/* Classes that have emptied out can be handed to a new size. */
+		if (!unused && Pool->Classes[i].FreeCnt == 0)
+			unused = &Pool->Classes[i];
+	}
+
+	if (!Create || !unused)
+		return NULL;
+
+	unused->Size = Size;
+	return unused;
+}
+
+void *
+pool_alloc(pool_t * Pool, size_t Size)
+{
+	int             node       = -1;
+	pool_link_t  *  link       = NULL;
+	pool_link_t  ** entry      = NULL;
+	pool_class_t *  size_class = NULL;
+
+	if (!Pool)
+		return malloc(Size);
+
+	if (Pool->NumaBind)
+		node = pool_current_node();
+
+	pthread_mutex_lock(&Pool->Lock);
+	{
+		size_class = pool_find_class(Pool, Size, 0);
+		if (size_class && size_class->FreeList)
+		{
+			/* Prefer a buffer bound to our node, otherwise take the first. */
+			entry = (pool_link_t **)&size_class->FreeList;
+			while (node >= 0 && *entry && (*entry)->Node != node)
+				entry = &(*entry)->Next;
+			if (!*entry)
+				entry = (pool_link_t **)&size_class->FreeList;
+
+			link   = *entry;
+			*entry = link->Next;
+			size_class->FreeCnt--;
+			Pool->CachedBytes -= Size;
+			Pool->Hits++;
+		} else
+		{
+			Pool->Misses++;
+		}
+	}
+	pthread_mutex_unlock(&Pool->Lock);
+
+	if (!link)
+		return pool_sys_alloc(Pool, Size);
+	return link;
+}
+
+void
+pool_free(pool_t * Pool, void * Buffer, size_t Size)
+{
+	pool_link_t  * link       = Buffer;
+	pool_class_t * size_class = NULL;
+
+	if (!Buffer)
+		return;
+
+	if (Pool && Size >= sizeof(pool_link_t))
+	{
+		pthread_mutex_lock(&Pool->Lock);
+		{
+			if ((Pool->CachedBytes + Size) <= Pool->MaxBytes)
+				size_class = pool_find_class(Pool, Size, 1);
+
+			if (size_class)
+			{
+				/* Pages were bound when mapped; carry that node along. */
+				link->Node           = Pool->NumaBind ? pool_buffer_node(Pool, Buffer) : -1;
+				link->Next           = size_class->FreeList;
+				size_class->FreeList = link;
+				size_class->FreeCnt++;
+				Pool->CachedBytes += Size;
+				Pool->Returns++;
+			} else
+			{
+				Pool->Releases++;
+			}
+		}
+		pthread_mutex_unlock(&Pool->Lock);
+
+		if (size_class)
+			return;
+	}
+
+	pool_sys_free(Pool, Buffer, Size);
+}
+
+void
+pool_destroy(pool_t * Pool)
+{
+	int           i;
+	pool_link_t * link  = NULL;
+	pool_node_t * entry = NULL;
+
+	if (!Pool)
+		return;
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "HPSS DSI buffer pool: hits=%"PRIu64" misses=%"PRIu64
+	                       " returns=%"PRIu64" releases=%"PRIu64" cached_bytes=%zu\n",
+	                       Pool->Hits,
+	                       Pool->Misses,
+	                       Pool->Returns,
+	                       Pool->Releases,
+	                       Pool->CachedBytes);
+
+	for (i = 0; i < POOL_MAX_CLASSES; i++)
+	{
+		while ((link = Pool->Classes[i].FreeList))
+		{
+			Pool->Classes[i].FreeList = link->Next;
+			pool_sys_free(Pool, link, Pool->Classes[i].Size);
+		}
+	}
+
+	/* Anything left belongs to buffers that were never returned. */
+	for (i = 0; i < POOL_NODE_BUCKETS; i++)
+	{
+		while ((entry = Pool->Nodes[i]))
+		{
+			Pool->Nodes[i] = entry->Next;
+			free(entry);
+		}
+	}
+
+	pthread_mutex_destroy(&Pool->Lock);
+	free(Pool);
+}
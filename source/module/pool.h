@@ -0,0 +1,121 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_POOL_H
+#define HPSS_DSI_POOL_H
+
+/*
+ * Session-scoped cache of transfer buffers. Transfers allocate BlockSize
+ * buffers by the handful; rather than handing them back to malloc() at
+ * the end of every transfer, keep them for the next one. Buffers are
+ * cached by exact size, up to MaxBytes in total.
+ *
+ * Buffers may be backed by huge pages to cut TLB misses on large block
+ * sizes, and may be bound to the NUMA node of the allocating thread.
+ */
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+#define POOL_MAX_CLASSES  8
+#define POOL_NODE_BUCKETS 64
+
+typedef enum {
+	POOL_ALLOC_MALLOC,      // malloc()
+	POOL_ALLOC_HUGEPAGE,    // 2MB huge pages for multiples of 2MB, else THP
+	POOL_ALLOC_HUGEPAGE_1G, // 1GB huge pages for multiples of 1GB, else THP
+} pool_allocator_t;
+
+typedef struct {
+	size_t   Size;     // 0 = unused class
+	void   * FreeList; // Linked through the head of each buffer
+	int      FreeCnt;
+} pool_class_t;
+
+/* Node a mapped buffer's pages were bound to. */
+typedef struct pool_node {
+	void             * Buffer;
+	int                Node;
+	struct pool_node * Next;
+} pool_node_t;
+
+typedef struct {
+	pthread_mutex_t  Lock;
+	size_t           MaxBytes;
+	size_t           CachedBytes;
+	pool_class_t     Classes[POOL_MAX_CLASSES];
+
+	pool_allocator_t Allocator;
+	int              NumaBind;
+	int              HugeTLBFailed; // Locked. Logged once, then use THP
+	pool_node_t    * Nodes[POOL_NODE_BUCKETS]; // Bound buffers, by address
+
+	/* Counters */
+	uint64_t        Hits;     // Allocations served from the cache
+	uint64_t        Misses;   // Allocations that went to the allocator
+	uint64_t        Returns;  // Frees kept in the cache
+	uint64_t        Releases; // Frees given back because of the limit
+} pool_t;
+
+globus_result_t
+pool_init(pool_t        ** Pool,
+          size_t           MaxBytes,
+          pool_allocator_t Allocator,
+          int              NumaBind);
+
+/* Both accept a NULL pool, in which case they are malloc() / free(). */
+void *
+pool_alloc(pool_t * Pool, size_t Size);
+
+void
+pool_free(pool_t * Pool, void * Buffer, size_t Size);
+
+void
+pool_destroy(pool_t * Pool);
+
+#endif /* HPSS_DSI_POOL_H */
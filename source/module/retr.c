@@ -49,12 +49,16 @@
  */
 #include "markers.h"
 #include "retr.h"
+#include "cksm.h"
 #include "pio.h"
+#include "blocksize.h"
+#include "stage.h"
 
 globus_result_t
-retr_open_for_reading(char * Pathname,
-	                  int  * FileFD,
-	                  int  * FileStripeWidth)
+retr_open_for_reading(char         * Pathname,
+	                  int          * FileFD,
+	                  int          * FileStripeWidth,
+	                  globus_off_t * OptimumAccessSize)
 {
 	hpss_cos_hints_t      hints_in;
 	hpss_cos_hints_t      hints_out;
@@ -85,10 +89,140 @@ retr_open_for_reading(char * Pathname,
 
 	/* Copy out the file stripe width. */
 	*FileStripeWidth = hints_out.StripeWidth;
+	CONVERT_U64_TO_LONGLONG(hints_out.OptimumAccessSize, *OptimumAccessSize);
 
     return GLOBUS_SUCCESS;
 }
 
+/* Called locked. */
+static void
+retr_free_buffer_push(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	RetrBuffer->Next      = RetrInfo->FreeBuffers;
+	RetrInfo->FreeBuffers = RetrBuffer;
+	RetrInfo->FreeBufferCnt++;
+}
+
+/* Called locked. */
+static retr_buffer_t *
+retr_free_buffer_pop(retr_info_t * RetrInfo)
+{
+	retr_buffer_t * retr_buffer = RetrInfo->FreeBuffers;
+
+	if (retr_buffer)
+	{
+		RetrInfo->FreeBuffers = retr_buffer->Next;
+		RetrInfo->FreeBufferCnt--;
+	}
+	return retr_buffer;
+}
+
+/*
+ * Called locked. Frees the buffer once the write and the hash are done. A
+ * borrowed buffer goes back to the callout waiting on it instead.
+ */
+static void
+retr_buffer_release(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	if (--RetrBuffer->Refs == 0 && !RetrBuffer->Borrowed)
+		retr_free_buffer_push(RetrInfo, RetrBuffer);
+}
+
+/* The hasher is done with a queued buffer. */
+static void
+retr_hash_released(void * Arg, char * Buffer)
+{
+	retr_buffer_t * retr_buffer = Arg;
+	retr_info_t   * retr_info   = retr_buffer->RetrInfo;
+
+	pthread_mutex_lock(&retr_info->Mutex);
+	{
+		retr_buffer_release(retr_info, retr_buffer);
+		pthread_cond_broadcast(&retr_info->Cond);
+	}
+	pthread_mutex_unlock(&retr_info->Mutex);
+}
+
+void
+retr_gridftp_callout(globus_gfs_operation_t Operation,
+                     globus_result_t        Result,
+                     globus_byte_t        * Buffer,
+                     globus_size_t          Length,
+                     void                 * UserArg);
+
+/* Called locked. */
+static void
+retr_queue_buffer(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	RetrBuffer->Next = NULL;
+	if (RetrInfo->QueueTail)
+		RetrInfo->QueueTail->Next = RetrBuffer;
+	else
+		RetrInfo->QueueHead = RetrBuffer;
+	RetrInfo->QueueTail = RetrBuffer;
+}
+
+/* Called locked. Returns 1 if RetrBuffer was queued and is no longer. */
+static int
+retr_queue_remove(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	retr_buffer_t *  prev  = NULL;
+	retr_buffer_t ** entry = &RetrInfo->QueueHead;
+
+	while (*entry && *entry != RetrBuffer)
+	{
+		prev  = *entry;
+		entry = &(*entry)->Next;
+	}
+	if (!*entry)
+		return 0;
+
+	*entry = RetrBuffer->Next;
+	if (RetrInfo->QueueTail == RetrBuffer)
+		RetrInfo->QueueTail = prev;
+	return 1;
+}
+
+/*
+ * Called locked. Registers queued blocks with the data channel, in queue
+ * order, until OptConnCnt writes are in flight. Called as blocks are
+ * queued and as writes complete, so the data channel paces itself.
+ */
+static globus_result_t
+retr_dispatch_writes(retr_info_t * RetrInfo)
+{
+	retr_buffer_t * retr_buffer = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	while (RetrInfo->QueueHead && RetrInfo->InFlightCnt < RetrInfo->OptConnCnt)
+	{
+		retr_buffer = RetrInfo->QueueHead;
+		RetrInfo->QueueHead = retr_buffer->Next;
+		if (!RetrInfo->QueueHead)
+			RetrInfo->QueueTail = NULL;
+
+		result = globus_gridftp_server_register_write(RetrInfo->Operation,
+		                                              (globus_byte_t *)retr_buffer->Buffer,
+		                                              retr_buffer->Length,
+		                                              retr_buffer->Offset,
+		                                              -1,
+		                                              retr_gridftp_callout,
+		                                              retr_buffer);
+		if (result)
+		{
+			retr_buffer_release(RetrInfo, retr_buffer);
+			break;
+		}
+
+		RetrInfo->InFlightCnt++;
+
+		/* Update perf markers */
+		markers_update_perf_markers(RetrInfo->Operation, retr_buffer->Offset, retr_buffer->Length);
+	}
+
+	return result;
+}
+
 void
 retr_gridftp_callout(globus_gfs_operation_t Operation,
                      globus_result_t        Result,
@@ -96,6 +230,8 @@ retr_gridftp_callout(globus_gfs_operation_t Operation,
                      globus_size_t          Length,
                      void                 * UserArg)
 {
+	globus_result_t result = GLOBUS_SUCCESS;
+
 	retr_buffer_t * retr_buffer = UserArg;
 	retr_info_t   * retr_info   = retr_buffer->RetrInfo;
 
@@ -105,13 +241,35 @@ retr_gridftp_callout(globus_gfs_operation_t Operation,
 	{
 		if (Result && !retr_info->Result) retr_info->Result = Result;
 
-		globus_list_insert(&retr_info->FreeBufferList, retr_buffer);
+		retr_buffer_release(retr_info, retr_buffer);
 assert(Length  <= retr_info->BlockSize);
-		pthread_cond_signal(&retr_info->Cond);
+		retr_info->InFlightCnt--;
+
+		/* Keep the data channel busy with whatever PIO read ahead. */
+		if (!retr_info->Result)
+		{
+			result = retr_dispatch_writes(retr_info);
+			if (result) retr_info->Result = result;
+		}
+
+		pthread_cond_broadcast(&retr_info->Cond);
 	}
 	pthread_mutex_unlock(&retr_info->Mutex);
 }
 
+/*
+ * Called locked. Check for the optimal number of concurrent writes.
+ */
+static void
+retr_check_concurrency(retr_info_t * RetrInfo)
+{
+	if (RetrInfo->ConnChkCnt++ == 0)
+		globus_gridftp_server_get_optimal_concurrency(RetrInfo->Operation,
+		                                             &RetrInfo->OptConnCnt);
+	if (RetrInfo->ConnChkCnt >= 100)
+		RetrInfo->ConnChkCnt = 0;
+}
+
 /*
  * Called locked.
  */
@@ -119,8 +277,6 @@ globus_result_t
 retr_get_free_buffer(retr_info_t   *  RetrInfo,
                      retr_buffer_t ** FreeBuffer)
 {
-	int all_buf_cnt  = 0;
-	int free_buf_cnt = 0;
 	int cur_conn_cnt = 0;
 
 	GlobusGFSName(retr_get_free_buffer);
@@ -130,50 +286,72 @@ retr_get_free_buffer(retr_info_t   *  RetrInfo,
 	 */
 	while (1)
 	{
-		/*
-		 * Check for the optimal number of concurrent writes.
-		 */
-		if (RetrInfo->ConnChkCnt++ == 0)
-			globus_gridftp_server_get_optimal_concurrency(RetrInfo->Operation,
-		                                             &RetrInfo->OptConnCnt);
-		if (RetrInfo->ConnChkCnt >= 100)
-			RetrInfo->ConnChkCnt = 0;
+		retr_check_concurrency(RetrInfo);
 
 		/* Check for error first. */
 		if (RetrInfo->Result)
 			return RetrInfo->Result;
 
-		/* We can exit the loop if we have less than OptConnCnt buffers in use. */
-		all_buf_cnt  = globus_list_size(RetrInfo->AllBufferList);
-		free_buf_cnt = globus_list_size(RetrInfo->FreeBufferList);
-
-		cur_conn_cnt = all_buf_cnt - free_buf_cnt;
-		if (cur_conn_cnt < RetrInfo->OptConnCnt)
+		/*
+		 * We can exit the loop if we have less than OptConnCnt buffers in
+		 * flight plus PipelineDepth blocks queued behind them.
+		 */
+		cur_conn_cnt = RetrInfo->AllBufferCnt - RetrInfo->FreeBufferCnt;
+		if (cur_conn_cnt < RetrInfo->OptConnCnt + RetrInfo->PipelineDepth)
 			break;
 
 		pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
 	}
 
-	if (!globus_list_empty(RetrInfo->FreeBufferList))
-	{
-		*FreeBuffer = globus_list_remove(&RetrInfo->FreeBufferList, RetrInfo->FreeBufferList);
+	if ((*FreeBuffer = retr_free_buffer_pop(RetrInfo)))
 		return GLOBUS_SUCCESS;
-	}
 
-	*FreeBuffer = malloc(sizeof(retr_info_t));
+	*FreeBuffer = malloc(sizeof(retr_buffer_t));
 	if (!*FreeBuffer)
 		return GlobusGFSErrorMemory("free_buffer");
-	(*FreeBuffer)->Buffer = malloc(RetrInfo->BlockSize);
+	(*FreeBuffer)->Buffer = pool_alloc(RetrInfo->Pool, RetrInfo->BlockSize);
 	if (!(*FreeBuffer)->Buffer)
+	{
+		free(*FreeBuffer);
+		*FreeBuffer = NULL;
 		return GlobusGFSErrorMemory("free_buffer");
+	}
 	(*FreeBuffer)->RetrInfo = RetrInfo;
 	(*FreeBuffer)->Valid    = VALID_TAG;
-	globus_list_insert(&RetrInfo->AllBufferList, *FreeBuffer);
+	(*FreeBuffer)->Borrowed = 0;
+	(*FreeBuffer)->Next     = NULL;
+	(*FreeBuffer)->AllNext  = RetrInfo->AllBuffers;
+	RetrInfo->AllBuffers    = *FreeBuffer;
+	RetrInfo->AllBufferCnt++;
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * Called locked. Waits until the data channel and the hasher are done with
+ * a borrowed buffer. Once the transfer has failed, a queued block will not
+ * be written and the hasher is told to drop what it holds.
+ */
+static void
+retr_wait_for_borrowed(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	while (RetrBuffer->Refs > 0)
+	{
+		if (RetrInfo->Result)
+		{
+			if (retr_queue_remove(RetrInfo, RetrBuffer))
+				RetrBuffer->Refs--;
+			if (RetrInfo->Hasher)
+				hasher_abort(RetrInfo->Hasher);
+			if (RetrBuffer->Refs == 0)
+				break;
+		}
+		pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
+	}
+	RetrBuffer->Valid = INVALID_TAG;
+}
+
 int
-retr_pio_callout(char     * ReadyBuffer,
+retr_pio_callout(char    ** ReadyBuffer,
                  uint32_t * Length,
                  uint64_t   Offset,
                  void     * CallbackArg)
@@ -182,6 +360,8 @@ retr_pio_callout(char     * ReadyBuffer,
 	retr_buffer_t * free_buffer  = NULL;
 	retr_info_t   * retr_info    = CallbackArg;
 	globus_result_t result       = GLOBUS_SUCCESS;
+	uint64_t        wait_start   = telemetry_now();
+	retr_buffer_t   borrowed;
 
 	GlobusGFSName(retr_pio_callout);
 
@@ -189,35 +369,95 @@ retr_pio_callout(char     * ReadyBuffer,
 	{
 assert(*Length <= retr_info->BlockSize);
 
-		result = retr_get_free_buffer(retr_info, &free_buffer);
-		if (result)
+		/* Stream mode sends in the order writes are registered; wait our turn. */
+		while (retr_info->ClntStripeWidth > 1 && Offset != retr_info->NextOffset && !retr_info->Result)
+		{
+			pthread_cond_wait(&retr_info->Cond, &retr_info->Mutex);
+		}
+
+		if (retr_info->Result)
 		{
-			if (!retr_info->Result) retr_info->Result = result;
 			rc = PIO_END_TRANSFER; /* Signal to shutdown. */
 			goto cleanup;
 		}
 
-		memcpy(free_buffer->Buffer, ReadyBuffer, *Length);
+		if (retr_info->ZeroCopy)
+		{
+			/*
+			 * HPSS does not touch its buffer until we return, so send it
+			 * as is and wait for the write below.
+			 */
+			memset(&borrowed, 0, sizeof(retr_buffer_t));
+			borrowed.Buffer   = *ReadyBuffer;
+			borrowed.RetrInfo = retr_info;
+			borrowed.Valid    = VALID_TAG;
+			borrowed.Borrowed = 1;
+			free_buffer       = &borrowed;
 
-		result = globus_gridftp_server_register_write(retr_info->Operation,
-		                                              (globus_byte_t *)free_buffer->Buffer,
-		                                              *Length,
-		                                              Offset,
-		                                              -1,
-		                                              retr_gridftp_callout,
-		                                              free_buffer);
+			retr_check_concurrency(retr_info);
+		} else
+		{
+			result = retr_get_free_buffer(retr_info, &free_buffer);
+			if (result)
+			{
+				if (!retr_info->Result) retr_info->Result = result;
+				rc = PIO_END_TRANSFER; /* Signal to shutdown. */
+				goto cleanup;
+			}
+			telemetry_record(&retr_info->Telemetry, TELEMETRY_WAIT, wait_start);
 
-		if (result)
+			memcpy(free_buffer->Buffer, *ReadyBuffer, *Length);
+		}
+
+		free_buffer->Offset = Offset;
+		free_buffer->Length = *Length;
+		free_buffer->Refs   = 1;
+
+		/*
+		 * The hasher reads the same buffer the data channel sends; it is
+		 * released once both are done with it. A failure here only costs us
+		 * the verification; retr_verify_checksum() will see it from
+		 * hasher_finish().
+		 */
+		if (retr_info->Hasher &&
+		    hasher_submit_shared(retr_info->Hasher,
+		                         free_buffer->Buffer,
+		                         *Length,
+		                         Offset,
+		                         retr_hash_released,
+		                         free_buffer) == GLOBUS_SUCCESS)
+		{
+			free_buffer->Refs++;
+		}
+
+		retr_queue_buffer(retr_info, free_buffer);
+
+		/* Let the participant with the next block go. */
+		retr_info->NextOffset = Offset + *Length;
+		pthread_cond_broadcast(&retr_info->Cond);
+
+		result = retr_dispatch_writes(retr_info);
+		if (result && !retr_info->Result)
+			retr_info->Result = result;
+
+		if (free_buffer == &borrowed)
+		{
+			retr_wait_for_borrowed(retr_info, &borrowed);
+			telemetry_record(&retr_info->Telemetry, TELEMETRY_WAIT, wait_start);
+		}
+
+		if (retr_info->Result)
 		{
-			if (!retr_info->Result) retr_info->Result = result;
 			rc = PIO_END_TRANSFER; /* Signal to shutdown. */
 			goto cleanup;
 		}
 
-		/* Update perf markers */
-		markers_update_perf_markers(retr_info->Operation, Offset, *Length);
+		telemetry_add_bytes(&retr_info->Telemetry, *Length);
 	}
 cleanup:
+	/* Other participants may be waiting on us. */
+	if (rc)
+		pthread_cond_broadcast(&retr_info->Cond);
 	pthread_mutex_unlock(&retr_info->Mutex);
 
 	return rc;
@@ -232,7 +472,7 @@ retr_wait_for_gridftp(retr_info_t * RetrInfo)
 		{
 			if (RetrInfo->Result) break;
 
-			if (globus_list_size(RetrInfo->AllBufferList) == globus_list_size(RetrInfo->FreeBufferList))
+			if (RetrInfo->AllBufferCnt == RetrInfo->FreeBufferCnt)
 				break;
 
 			pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
@@ -265,15 +505,76 @@ retr_range_complete_callback(globus_off_t * Offset,
 			*Length = retr_info->FileSize - *Offset;
 		retr_info->RangeLength = *Length;
 	}
+
+	/* The participants are idle between ranges. */
+	pthread_mutex_lock(&retr_info->Mutex);
+	{
+		retr_info->NextOffset = *Offset;
+	}
+	pthread_mutex_unlock(&retr_info->Mutex);
 }
 
-static int
-release_buffer(void * Datum, void * Arg)
+static void
+release_buffers(retr_info_t * RetrInfo)
 {
-	((retr_buffer_t *)Datum)->Valid = INVALID_TAG;
-	free(((retr_buffer_t *)Datum)->Buffer);
+	retr_buffer_t * retr_buffer = NULL;
 
-	return 0;
+	while ((retr_buffer = RetrInfo->AllBuffers))
+	{
+		RetrInfo->AllBuffers = retr_buffer->AllNext;
+		retr_buffer->Valid   = INVALID_TAG;
+		pool_free(RetrInfo->Pool, retr_buffer->Buffer, RetrInfo->BlockSize);
+		free(retr_buffer);
+	}
+}
+
+/*
+ * Compares the data sent against the stored checksum. Returns the
+ * transfer's result, which only changes on a mismatch in 'fail' mode.
+ */
+static globus_result_t
+retr_verify_checksum(retr_info_t * RetrInfo, globus_result_t Result)
+{
+	char          * cksm_string = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	GlobusGFSName(retr_verify_checksum);
+
+	/* Small files are hashed inline, without a hasher. */
+	if (RetrInfo->Hasher)
+	{
+		result = hasher_finish(RetrInfo->Hasher, Result != GLOBUS_SUCCESS, NULL, NULL);
+		RetrInfo->Hasher = NULL;
+	}
+	if (Result)
+		return Result;
+
+	if (!result)
+		result = checksum_final(RetrInfo->Checksum, &cksm_string);
+	if (result)
+	{
+		/* We could not check it; that is not the data's fault. */
+		globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+		                       "HPSS DSI: could not verify the checksum of %s\n",
+		                       RetrInfo->TransferInfo->pathname);
+		return GLOBUS_SUCCESS;
+	}
+
+	if (strcasecmp(cksm_string, RetrInfo->ExpectedChecksum) != 0)
+	{
+		globus_gfs_log_message(GLOBUS_GFS_LOG_ERR,
+		                       "HPSS DSI: %s checksum mismatch on %s: stored %s, sent %s\n",
+		                       checksum_name(RetrInfo->Checksum),
+		                       RetrInfo->TransferInfo->pathname,
+		                       RetrInfo->ExpectedChecksum,
+		                       cksm_string);
+
+		if (RetrInfo->Verify == RETR_VERIFY_FAIL)
+			result = GlobusGFSErrorGeneric("Data does not match the stored checksum");
+	}
+
+	free(cksm_string);
+	return result;
 }
 
 void
@@ -283,6 +584,7 @@ retr_transfer_complete_callback (globus_result_t Result,
 	globus_result_t result    = Result;
 	retr_info_t   * retr_info = UserArg;
 	int             rc        = 0;
+	uint64_t        start     = telemetry_now();
 
 	GlobusGFSName(retr_transfer_complete_callback);
 
@@ -290,105 +592,477 @@ retr_transfer_complete_callback (globus_result_t Result,
 	if (retr_info->Result)
 		result = retr_info->Result;
 
-	if (result)
-	{
-		retr_wait_for_gridftp(retr_info);
+	/* Let the data channel drain any blocks PIO read ahead. */
+	retr_wait_for_gridftp(retr_info);
+	if (retr_info->Result)
 		result = retr_info->Result;
-	}
+	telemetry_record(&retr_info->Telemetry, TELEMETRY_WAIT, start);
 
+	start = telemetry_now();
 	rc = hpss_Close(retr_info->FileFD);
 	if (rc && !result)
 		result = GlobusGFSErrorSystemError("hpss_Close", -rc);
+	telemetry_record(&retr_info->Telemetry, TELEMETRY_CLOSE, start);
+
+	if (retr_info->Checksum)
+		result = retr_verify_checksum(retr_info, result);
+	checksum_destroy(retr_info->Checksum);
+	if (retr_info->ExpectedChecksum)
+		free(retr_info->ExpectedChecksum);
 
+	telemetry_finish(&retr_info->Telemetry, retr_info->TransferInfo->pathname, result);
 	globus_gridftp_server_finished_transfer(retr_info->Operation, result);
 
+	if (retr_info->SmallBuffer)
+		pool_free(retr_info->Pool, retr_info->SmallBuffer, retr_info->SmallBufferSize);
 	pthread_mutex_destroy(&retr_info->Mutex);
 	pthread_cond_destroy(&retr_info->Cond);
-	globus_list_free(retr_info->FreeBufferList);
-	globus_list_search_pred(retr_info->AllBufferList, release_buffer, NULL);
-	globus_list_destroy_all(retr_info->AllBufferList, free);
+	release_buffers(retr_info);
 	free(retr_info);
 }
 
-void
-retr(globus_gfs_operation_t       Operation,
-     globus_gfs_transfer_info_t * TransferInfo)
+/* Sets up verification if the file has a stored checksum we can compute. */
+static globus_result_t
+retr_start_verify(retr_info_t * RetrInfo, config_t * Config)
 {
-	int             rc                = 0;
-	int             file_stripe_width = 0;
-	retr_info_t   * retr_info         = NULL;
-	globus_off_t    offset            = 0;
-	globus_result_t result            = GLOBUS_SUCCESS;
-	hpss_stat_t     hpss_stat_buf;
+	char          * algorithm = NULL;
+	globus_result_t result    = GLOBUS_SUCCESS;
 
-	GlobusGFSName(retr);
+	GlobusGFSName(retr_start_verify);
 
-	rc = hpss_Stat(TransferInfo->pathname, &hpss_stat_buf);
-	if (rc)
+	result = cksm_get_checksum(RetrInfo->TransferInfo->pathname,
+	                           Config,
+	                           &algorithm,
+	                           &RetrInfo->ExpectedChecksum);
+	if (result || !algorithm)
+		return result;
+
+	RetrInfo->Verify = Config->RetrVerifyChecksum;
+
+	/* Stored by some other tool in an algorithm we don't have. */
+	checksum_init(&RetrInfo->Checksum, algorithm);
+	free(algorithm);
+
+	return GLOBUS_SUCCESS;
+}
+
+static void
+retr_small_file_read_range(retr_info_t * RetrInfo);
+
+static void
+retr_small_file_callout(globus_gfs_operation_t Operation,
+                        globus_result_t        Result,
+                        globus_byte_t        * Buffer,
+                        globus_size_t          Length,
+                        void                 * UserArg)
+{
+	retr_info_t * retr_info = UserArg;
+
+	telemetry_record(&retr_info->Telemetry, TELEMETRY_WAIT, retr_info->SmallWriteStart);
+
+	if (Result)
 	{
-		result = GlobusGFSErrorSystemError("hpss_Stat", -rc);
+		retr_transfer_complete_callback(Result, retr_info);
+		return;
+	}
+
+	retr_info->SmallOffset += retr_info->RangeLength;
+	retr_info->RangeLength  = 0;
+	retr_small_file_read_range(retr_info);
+}
+
+/*
+ * Sends the next range of a small file, or finishes the transfer once
+ * there are no more. Runs on the session thread for the first range and
+ * on the data channel's callback thread after that.
+ */
+static void
+retr_small_file_read_range(retr_info_t * RetrInfo)
+{
+	ssize_t         bytes  = 0;
+	globus_off_t    length = 0;
+	globus_result_t result = GLOBUS_SUCCESS;
+	uint64_t        start  = 0;
+
+	GlobusGFSName(retr_small_file_read_range);
+
+	if (RetrInfo->RangeLength == 0)
+	{
+		globus_gridftp_server_get_read_range(RetrInfo->Operation,
+		                                     &RetrInfo->SmallOffset,
+		                                     &RetrInfo->RangeLength);
+		if (RetrInfo->RangeLength == -1)
+			RetrInfo->RangeLength = RetrInfo->FileSize - RetrInfo->SmallOffset;
+	}
+
+	if (RetrInfo->RangeLength <= 0)
+	{
+		retr_transfer_complete_callback(GLOBUS_SUCCESS, RetrInfo);
+		return;
+	}
+
+	if (RetrInfo->RangeLength > RetrInfo->SmallBufferSize)
+	{
+		result = GlobusGFSErrorGeneric("Requested range is beyond the end of the file");
 		goto cleanup;
 	}
 
-	/*
-	 * Create our structure.
-	 */
-	retr_info = malloc(sizeof(retr_info_t));
-	if (!retr_info)
+	start = telemetry_now();
+	bytes = hpss_Lseek(RetrInfo->FileFD, RetrInfo->SmallOffset, SEEK_SET);
+	if (bytes < 0)
 	{
-		result = GlobusGFSErrorMemory("retr_info_t");
+		result = GlobusGFSErrorSystemError("hpss_Lseek", -bytes);
 		goto cleanup;
 	}
-	memset(retr_info, 0, sizeof(retr_info_t));
-	retr_info->Operation    = Operation;
-	retr_info->TransferInfo = TransferInfo;
-	retr_info->FileFD       = -1;
-	retr_info->FileSize     = hpss_stat_buf.st_size;
-	pthread_mutex_init(&retr_info->Mutex, NULL);
-	pthread_cond_init(&retr_info->Cond, NULL);
 
-	globus_gridftp_server_get_block_size(Operation, &retr_info->BlockSize);
+	while (length < RetrInfo->RangeLength)
+	{
+		bytes = hpss_Read(RetrInfo->FileFD,
+		                  RetrInfo->SmallBuffer + length,
+		                  RetrInfo->RangeLength - length);
+		if (bytes < 0)
+		{
+			result = GlobusGFSErrorSystemError("hpss_Read", -bytes);
+			goto cleanup;
+		}
+		if (bytes == 0)
+		{
+			result = GlobusGFSErrorGeneric("Unexpected end of file");
+			goto cleanup;
+		}
+		length += bytes;
+	}
+
+	telemetry_record(&RetrInfo->Telemetry, TELEMETRY_HPSS, start);
+	telemetry_add_bytes(&RetrInfo->Telemetry, length);
+
+	if (RetrInfo->Checksum)
+		checksum_update(RetrInfo->Checksum, RetrInfo->SmallBuffer, length);
+
+	markers_update_perf_markers(RetrInfo->Operation, RetrInfo->SmallOffset, length);
+
+	RetrInfo->SmallWriteStart = telemetry_now();
+	result = globus_gridftp_server_register_write(RetrInfo->Operation,
+	                                              (globus_byte_t *)RetrInfo->SmallBuffer,
+	                                              length,
+	                                              RetrInfo->SmallOffset,
+	                                              -1,
+	                                              retr_small_file_callout,
+	                                              RetrInfo);
+
+cleanup:
+	if (result)
+		retr_transfer_complete_callback(result, RetrInfo);
+}
+
+/*
+ * Fails a transfer before PIO or the small file path has taken it over.
+ */
+static void
+retr_abort(retr_info_t * RetrInfo, globus_result_t Result)
+{
+	telemetry_finish(&RetrInfo->Telemetry, RetrInfo->TransferInfo->pathname, Result);
+	globus_gridftp_server_finished_transfer(RetrInfo->Operation, Result);
+
+	if (RetrInfo->FileFD != -1)
+		hpss_Close(RetrInfo->FileFD);
+	if (RetrInfo->Hasher)
+		hasher_finish(RetrInfo->Hasher, 1, NULL, NULL);
+	checksum_destroy(RetrInfo->Checksum);
+	if (RetrInfo->ExpectedChecksum)
+		free(RetrInfo->ExpectedChecksum);
+	pthread_mutex_destroy(&RetrInfo->Mutex);
+	pthread_cond_destroy(&RetrInfo->Cond);
+	free(RetrInfo);
+}
+
+/*
+ * Opens the file and moves its data. Either finishes the transfer itself or
+ * hands it to the small file path or to PIO.
+ */
+static void
+retr_start(retr_info_t * RetrInfo)
+{
+	globus_gfs_transfer_info_t * transfer_info = RetrInfo->TransferInfo;
+	config_t                   * config        = RetrInfo->Config;
+	int                          file_stripe_width   = 0;
+	globus_off_t                 offset              = 0;
+	globus_off_t                 optimum_access_size = 0;
+	globus_result_t              result              = GLOBUS_SUCCESS;
+	uint64_t                     start               = telemetry_now();
+
+	GlobusGFSName(retr_start);
 
 	/*
 	 * Open the file.
 	 */
-	result = retr_open_for_reading(TransferInfo->pathname,
-	                               &retr_info->FileFD,
-	                               &file_stripe_width);
+	result = retr_open_for_reading(transfer_info->pathname,
+	                               &RetrInfo->FileFD,
+	                               &file_stripe_width,
+	                               &optimum_access_size);
 	if (result) goto cleanup;
+	telemetry_record(&RetrInfo->Telemetry, TELEMETRY_OPEN, start);
+
+	RetrInfo->BlockSize = blocksize_select(config,
+	                                       transfer_info->pathname,
+	                                       RetrInfo->BlockSize,
+	                                       RetrInfo->FileSize,
+	                                       file_stripe_width,
+	                                       optimum_access_size);
 
-	globus_gridftp_server_begin_transfer(Operation, 0, NULL);
+	if (!RetrInfo->TransferBegun)
+	{
+		globus_gridftp_server_begin_transfer(RetrInfo->Operation, 0, NULL);
+		RetrInfo->TransferBegun = 1;
+	}
+
+	globus_gridftp_server_get_read_range(RetrInfo->Operation, &offset, &RetrInfo->RangeLength);
+	if (RetrInfo->RangeLength == -1)
+		RetrInfo->RangeLength = RetrInfo->FileSize - offset;
+	RetrInfo->NextOffset = offset;
 
-	globus_gridftp_server_get_read_range(Operation, &offset, &retr_info->RangeLength);
-	if (retr_info->RangeLength == -1)
-		retr_info->RangeLength = retr_info->FileSize - offset;
+	if (config->RetrVerifyChecksum != RETR_VERIFY_OFF && cksm_is_whole_file(transfer_info))
+	{
+		result = retr_start_verify(RetrInfo, config);
+		if (result) goto cleanup;
+	}
+
+	/*
+	 * For small files, setting up PIO costs more than moving the data.
+	 * retr_transfer_complete_callback() finishes from here on.
+	 */
+	if (config->SmallFileThreshold && RetrInfo->FileSize <= config->SmallFileThreshold)
+	{
+		/* Sized for this file, not the largest small file. */
+		RetrInfo->SmallBufferSize = blocksize_class(config, RetrInfo->FileSize);
+		RetrInfo->SmallBuffer     = pool_alloc(RetrInfo->Pool, RetrInfo->SmallBufferSize);
+		if (!RetrInfo->SmallBuffer)
+		{
+			result = GlobusGFSErrorMemory("small file buffer");
+			goto cleanup;
+		}
+
+		RetrInfo->SmallOffset = offset;
+		retr_small_file_read_range(RetrInfo);
+		return;
+	}
+
+	if (RetrInfo->Checksum)
+	{
+		result = hasher_start(&RetrInfo->Hasher,
+		                      checksum_update,
+		                      RetrInfo->Checksum,
+		                      0,
+		                      RetrInfo->BlockSize,
+		                      CKSM_HASH_QUEUE_DEPTH,
+		                      RetrInfo->Pool);
+		if (result) goto cleanup;
+	}
 
 	/*
 	 * Setup PIO
 	 */
 	result = pio_start(HPSS_PIO_READ,
-	                   retr_info->FileFD,
+	                   RetrInfo->FileFD,
 	                   file_stripe_width,
-	                   retr_info->BlockSize,
+	                   config->ClientStripeWidth,
+	                   RetrInfo->BlockSize,
+	                   RetrInfo->Pool,
+	                   &RetrInfo->Telemetry,
 	                   offset,
-	                   retr_info->RangeLength,
+	                   RetrInfo->RangeLength,
 	                   retr_pio_callout,
 	                   retr_range_complete_callback,
 	                   retr_transfer_complete_callback,
-	                   retr_info);
+	                   RetrInfo);
 
 cleanup:
 	if (result)
+		retr_abort(RetrInfo, result);
+}
+
+/*
+ * Runs every marker interval while the file stages and starts the transfer
+ * once the stage manager is done with the file. Nothing is sent to the
+ * client meanwhile; the server has no marker to send for data not yet read,
+ * so a client with a short idle timeout can still give up on the recall.
+ */
+static void
+retr_stage_wait_callback(void * UserArg)
+{
+	retr_info_t * retr_info = UserArg;
+	int           staged    = 0;
+
+	pthread_mutex_lock(&retr_info->Mutex);
 	{
-		globus_gridftp_server_finished_transfer(Operation, result);
-		if (retr_info)
+		if (!retr_info->StageDone && !stage_mgr_is_staging(&retr_info->BitfileId))
+			retr_info->StageDone = staged = 1;
+	}
+	pthread_mutex_unlock(&retr_info->Mutex);
+
+	if (!staged)
+		return;
+
+	globus_callback_unregister(retr_info->StageHandle, NULL, NULL, NULL);
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "RETR of %s waited %d seconds for stage\n",
+	                       retr_info->TransferInfo->pathname,
+	                       (int)(time(NULL) - retr_info->StageStart));
+
+	retr_start(retr_info);
+}
+
+/* Runs once StageHandle can no longer fire. */
+static void
+retr_stage_aborted_callback(void * UserArg)
+{
+	retr_info_t * retr_info = UserArg;
+
+	GlobusGFSName(retr_stage_aborted_callback);
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "RETR of %s aborted after waiting %d seconds for stage\n",
+	                       retr_info->TransferInfo->pathname,
+	                       (int)(time(NULL) - retr_info->StageStart));
+
+	retr_abort(retr_info, GlobusGFSErrorGeneric("Transfer aborted while the file was staging"));
+}
+
+void
+retr_transfer_event(globus_gfs_event_info_t * EventInfo)
+{
+	retr_info_t   * retr_info = EventInfo->event_arg;
+	int             staging   = 0;
+	globus_result_t result    = GLOBUS_SUCCESS;
+
+	GlobusGFSName(retr_transfer_event);
+
+	if (EventInfo->type != GLOBUS_GFS_EVENT_TRANSFER_ABORT)
+		return;
+
+	pthread_mutex_lock(&retr_info->Mutex);
+	{
+		if (!retr_info->StageDone)
+		{
+			retr_info->StageDone = staging = 1;
+		} else if (!retr_info->Result)
 		{
-			if (retr_info->FileFD != -1)
-				hpss_Close(retr_info->FileFD);
-			pthread_mutex_destroy(&retr_info->Mutex);
-			pthread_cond_destroy(&retr_info->Cond);
-			free(retr_info);
+			/* Already moving data; PIO and the data channel stop on this. */
+			retr_info->Result = GlobusGFSErrorGeneric("Transfer aborted");
 		}
+		pthread_cond_broadcast(&retr_info->Cond);
 	}
+	pthread_mutex_unlock(&retr_info->Mutex);
+
+	if (!staging)
+		return;
+
+	result = globus_callback_unregister(retr_info->StageHandle,
+	                                    retr_stage_aborted_callback,
+	                                    retr_info,
+	                                    NULL);
+	if (result)
+		retr_stage_aborted_callback(retr_info);
 }
 
+/*
+ * Returns 1 if the file is being staged and retr_stage_wait_callback() will
+ * start the transfer, 0 to start it now.
+ */
+static int
+retr_stage_first(retr_info_t * RetrInfo)
+{
+	globus_result_t      result = GLOBUS_SUCCESS;
+	globus_reltime_t     delay;
+	stage_file_residency residency;
+	int                  marker_freq = 0;
+
+	/*
+	 * Any trouble here falls back to letting hpss_Open() wait on the
+	 * recall, as it does without RetrStageFirst.
+	 */
+	result = stage_start(RetrInfo->TransferInfo->pathname, &RetrInfo->BitfileId, &residency);
+	if (result || residency != STAGE_FILE_ARCHIVED)
+		return 0;
+
+	globus_gridftp_server_get_update_interval(RetrInfo->Operation, &marker_freq);
+	if (marker_freq <= 0)
+		marker_freq = RETR_STAGE_POLL_SECS;
+
+	GlobusTimeReltimeSet(delay, marker_freq, 0);
+
+	/* An abort must not see StageDone clear until StageHandle is set. */
+	pthread_mutex_lock(&RetrInfo->Mutex);
+	{
+		globus_gridftp_server_begin_transfer(RetrInfo->Operation,
+		                                     GLOBUS_GFS_EVENT_TRANSFER_ABORT,
+		                                     RetrInfo);
+		RetrInfo->TransferBegun = 1;
+		RetrInfo->StageStart    = time(NULL);
+
+		result = globus_callback_register_periodic(&RetrInfo->StageHandle,
+		                                           &delay,
+		                                           &delay,
+		                                           retr_stage_wait_callback,
+		                                           RetrInfo);
+		if (result)
+			RetrInfo->StageDone = 1;
+	}
+	pthread_mutex_unlock(&RetrInfo->Mutex);
+
+	return (result == GLOBUS_SUCCESS);
+}
+
+void
+retr(globus_gfs_operation_t       Operation,
+     globus_gfs_transfer_info_t * TransferInfo,
+     config_t                   * Config)
+{
+	int             rc        = 0;
+	retr_info_t   * retr_info = NULL;
+	globus_result_t result    = GLOBUS_SUCCESS;
+	hpss_stat_t     hpss_stat_buf;
+
+	GlobusGFSName(retr);
+
+	/* Not from the attribute cache; the length must be current. */
+	rc = hpss_Stat(TransferInfo->pathname, &hpss_stat_buf);
+	if (rc)
+	{
+		result = GlobusGFSErrorSystemError("hpss_Stat", -rc);
+		globus_gridftp_server_finished_transfer(Operation, result);
+		return;
+	}
+
+	/*
+	 * Create our structure.
+	 */
+	retr_info = malloc(sizeof(retr_info_t));
+	if (!retr_info)
+	{
+		result = GlobusGFSErrorMemory("retr_info_t");
+		globus_gridftp_server_finished_transfer(Operation, result);
+		return;
+	}
+	memset(retr_info, 0, sizeof(retr_info_t));
+	retr_info->Operation    = Operation;
+	retr_info->TransferInfo = TransferInfo;
+	retr_info->Config       = Config;
+	retr_info->FileFD       = -1;
+	retr_info->FileSize     = hpss_stat_buf.st_size;
+	retr_info->Pool         = Config->BufferPool;
+	retr_info->ClntStripeWidth = Config->ClientStripeWidth;
+	retr_info->PipelineDepth   = Config->RetrPipelineDepth;
+	retr_info->ZeroCopy        = Config->RetrZeroCopy;
+	pthread_mutex_init(&retr_info->Mutex, NULL);
+	pthread_cond_init(&retr_info->Cond, NULL);
+	telemetry_init(&retr_info->Telemetry, "RETR");
+
+	globus_gridftp_server_get_block_size(Operation, &retr_info->BlockSize);
+
+	if (Config->RetrStageFirst && retr_stage_first(retr_info))
+		return;
+
+	retr_start(retr_info);
+}
@@ -50,21 +50,34 @@
  * Globus includes
  */
 #include <globus_gridftp_server.h>
-#include <globus_list.h>
 
 /*
  * Local includes
  */
+#include "config.h"
 #include "pio.h"
+#include "hasher.h"
+#include "checksum.h"
+
+/* How often a RETR waiting on a stage checks it when markers are off. */
+#define RETR_STAGE_POLL_SECS 5
 
 struct retr_info;
 
-typedef struct {
+typedef struct retr_buffer {
     char             * Buffer;
     struct retr_info * RetrInfo;
 #define VALID_TAG   0xDEADBEEF
 #define INVALID_TAG 0x00000000
     int                Valid; // Debug Entry
+
+    globus_off_t       Offset;   // Set while queued for the data channel
+    globus_size_t      Length;
+    int                Refs;     // Data channel write and hasher
+    int                Borrowed; // PIO's buffer; never on the free list
+
+    struct retr_buffer * Next;    // Free list or write queue
+    struct retr_buffer * AllNext; // All buffers list
 } retr_buffer_t;
 
 typedef struct retr_info {
@@ -77,6 +90,7 @@ typedef struct retr_info {
 	globus_result_t Result;
 	globus_size_t   BlockSize;
 	globus_off_t    RangeLength;
+	pool_t        * Pool;
 
 	pthread_mutex_t Mutex;
 	pthread_cond_t  Cond;
@@ -84,13 +98,73 @@ typedef struct retr_info {
 	int OptConnCnt;
 	int ConnChkCnt;
 
-	globus_list_t * AllBufferList;
-	globus_list_t * FreeBufferList;
+	/*
+	 * Send the buffers HPSS filled instead of copies. Each callout waits
+	 * for its own write, so PipelineDepth does not apply.
+	 */
+	int ZeroCopy;
+
+	/*
+	 * Filled blocks wait in the write queue until fewer than OptConnCnt
+	 * writes are in flight. PipelineDepth is how many blocks PIO may
+	 * read ahead of the data channel.
+	 */
+	int             PipelineDepth;
+	int             InFlightCnt;
+	retr_buffer_t * QueueHead;
+	retr_buffer_t * QueueTail;
+
+	/*
+	 * With more than one participant, blocks show up out of order.
+	 * Writes are registered in offset order starting at NextOffset.
+	 */
+	int          ClntStripeWidth;
+	globus_off_t NextOffset;
+
+	retr_buffer_t * AllBuffers;
+	retr_buffer_t * FreeBuffers;
+
+	int AllBufferCnt;
+	int FreeBufferCnt;
+
+	/*
+	 * Small files skip PIO. Each range is read into SmallBuffer with
+	 * hpss_Read() and sent as a single write.
+	 */
+	char          * SmallBuffer;
+	globus_size_t   SmallBufferSize;
+	globus_off_t    SmallOffset;
+	uint64_t        SmallWriteStart;
+
+	/* Inline verification against the stored checksum. */
+	int          Verify; // retr_verify_t
+	char       * ExpectedChecksum;
+	checksum_t * Checksum;
+	hasher_t   * Hasher;
+
+	config_t    * Config;
+	int           TransferBegun;
+	telemetry_t   Telemetry;
+
+	/*
+	 * With RetrStageFirst, an archived file is staged before it is opened.
+	 * StageHandle polls the stage manager until the stage finishes or the
+	 * client aborts. StageDone is set, locked, by whichever comes first.
+	 */
+	hpssoid_t                BitfileId;
+	globus_callback_handle_t StageHandle;
+	time_t                   StageStart;
+	int                      StageDone;
 
 } retr_info_t;
 
 void
 retr(globus_gfs_operation_t       Operation,
-     globus_gfs_transfer_info_t * TransferInfo);
+     globus_gfs_transfer_info_t * TransferInfo,
+     config_t                   * Config);
+
+/* Transfer events asked for by globus_gridftp_server_begin_transfer(). */
+void
+retr_transfer_event(globus_gfs_event_info_t * EventInfo);
 
 #endif /* HPSS_DSI_RETR_H */
@@ -42,16 +42,12 @@
 /*
  * System includes
  */
-#include <sys/select.h>
-#include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-/*
- * Globus includes
- */
-#include <globus_list.h>
-
 /*
  * HPSS includes
  */
@@ -62,50 +58,7 @@
  */
 #include "stage.h"
 #include "stat.h"
-
-static globus_list_t * _gStageList = NULL;
-
-int
-stage_match_bitfileid(void * Datum, void * Arg)
-{
-	return (memcmp((hpssoid_t *)Datum, (hpssoid_t *) Arg, sizeof(hpssoid_t)) == 0);
-}
-
-extern globus_list_t *
-globus_list_search_pred (globus_list_t * head,
-             globus_list_pred_t predicate,
-             void * pred_args);
-
-void
-stage_add_bfid_to_list(hpssoid_t * BitFileID)
-{
-	hpssoid_t * alloced_bfid = malloc(sizeof(hpssoid_t));
-	memcpy(alloced_bfid, BitFileID, sizeof(hpssoid_t));
-	globus_list_insert(&_gStageList, alloced_bfid);
-}
-
-void
-stage_rm_bfid_from_list(hpssoid_t * BitFileID)
-{
-	globus_list_t * match = globus_list_search_pred(_gStageList,
-	                                                stage_match_bitfileid,
-	                                                BitFileID);
-	if (match)
-	{
-		hpssoid_t * alloced_bfid = globus_list_remove(&_gStageList, match);
-		free(alloced_bfid);
-	}
-}
-
-int
-stage_check_bfid_in_list(hpssoid_t * BitFileID)
-{
-	globus_list_t * match = globus_list_search_pred(_gStageList,
-	                                                stage_match_bitfileid,
-	                                                BitFileID);
-
-	return (match != NULL);
-}
+#include "bfidset.h"
 
 globus_result_t
 stage_get_timeout(globus_gfs_operation_t      Operation,
@@ -241,17 +194,452 @@ stage_get_residency(char * Pathname, stage_file_residency * Residency)
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * Stage manager. hpss_StageCallBack() requests are tracked here and a
+ * single background thread checks their residency, backing off while the
+ * recall runs. Sessions waiting on a stage sleep until the manager sees it
+ * finish instead of polling HPSS themselves, and any number of SITE STAGEs
+ * of one file cost one residency check per interval.
+ *
+ * Batch stages are queued unissued, in tape order, and the manager issues
+ * them as earlier ones finish so that at most MaxIssued are outstanding.
+ *
+ * Requests are kept in issue order on a list and by bitfile ID in Tracked,
+ * whose TTL drops requests that have been queued or running for longer than
+ * STAGE_TRACK_SECS.
+ */
+typedef struct stage_request {
+	hpssoid_t              BitfileId;
+	char                 * Pathname;
+	u_signed64             DataLength;
+	int                    Issued;
+	time_t                 NextCheck;
+	int                    Interval;
+	struct stage_request * Prev;
+	struct stage_request * Next;
+} stage_request_t;
+
+static struct {
+	pthread_mutex_t   Lock;
+	pthread_cond_t    Wakeup;  // Wakes the manager
+	pthread_cond_t    Changed; // Wakes waiters when requests finish
+	int               Running;
+	int               MaxIssued;
+	int               IssuedCnt;
+	stage_request_t * Requests; // In the order they are issued
+	stage_request_t * Tail;
+	bfidset_t         Tracked;
+	time_t            NextExpire;
+} _gStageMgr = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	0,
+	1,
+};
+
+static pthread_once_t _gStageMgrOnce = PTHREAD_ONCE_INIT;
+
+static void
+stage_mgr_init()
+{
+	bfidset_init(&_gStageMgr.Tracked, STAGE_TRACK_SECS);
+}
+
+static void
+stage_mgr_lock()
+{
+	pthread_once(&_gStageMgrOnce, stage_mgr_init);
+	pthread_mutex_lock(&_gStageMgr.Lock);
+}
+
+/* Called locked. */
+static stage_request_t *
+stage_mgr_find(hpssoid_t * BitfileId)
+{
+	return bfidset_lookup(&_gStageMgr.Tracked, BitfileId);
+}
+
+/*
+ * Called locked. Returns 0 if added, 1 if the file is already tracked, -1
+ * if out of memory.
+ */
+static int
+stage_mgr_append(stage_request_t * Request)
+{
+	int rc = bfidset_insert(&_gStageMgr.Tracked, &Request->BitfileId, Request);
+
+	if (rc)
+		return rc;
+
+	Request->Prev = _gStageMgr.Tail;
+	Request->Next = NULL;
+	if (_gStageMgr.Tail)
+		_gStageMgr.Tail->Next = Request;
+	else
+		_gStageMgr.Requests = Request;
+	_gStageMgr.Tail = Request;
+
+	if (Request->Issued)
+		_gStageMgr.IssuedCnt++;
+	return 0;
+}
+
+/* Called locked. Takes the request off the list and frees it. */
+static void
+stage_mgr_unlink(stage_request_t * Request)
+{
+	if (Request->Prev)
+		Request->Prev->Next = Request->Next;
+	else
+		_gStageMgr.Requests = Request->Next;
+	if (Request->Next)
+		Request->Next->Prev = Request->Prev;
+	else
+		_gStageMgr.Tail = Request->Prev;
+
+	if (Request->Issued)
+		_gStageMgr.IssuedCnt--;
+
+	free(Request->Pathname);
+	free(Request);
+	pthread_cond_broadcast(&_gStageMgr.Changed);
+}
+
+/* Called locked. */
+static void
+stage_mgr_remove(stage_request_t * Request)
+{
+	bfidset_remove(&_gStageMgr.Tracked, &Request->BitfileId);
+	stage_mgr_unlink(Request);
+}
+
+/* Called locked, from bfidset_expire(). */
+static void
+stage_mgr_expired(void * Value, void * Arg)
+{
+	stage_request_t * request = Value;
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+	                       "HPSS DSI: gave up tracking the stage of %s\n",
+	                       request->Pathname);
+	stage_mgr_unlink(request);
+}
+
+static stage_request_t *
+stage_mgr_new_request(char * Pathname, hpssoid_t * BitfileId, u_signed64 DataLength)
+{
+	stage_request_t * request = malloc(sizeof(stage_request_t));
+
+	if (!request)
+		return NULL;
+	memset(request, 0, sizeof(stage_request_t));
+
+	request->Pathname = strdup(Pathname);
+	if (!request->Pathname)
+	{
+		free(request);
+		return NULL;
+	}
+	request->BitfileId  = *BitfileId;
+	request->DataLength = DataLength;
+	return request;
+}
+
+static void
+stage_mgr_free_request(stage_request_t * Request)
+{
+	free(Request->Pathname);
+	free(Request);
+}
+
+/* Called locked. */
+static void
+stage_mgr_mark_issued(stage_request_t * Request)
+{
+	Request->Issued    = 1;
+	Request->NextCheck = time(NULL) + STAGE_POLL_MIN_SECS;
+	Request->Interval  = STAGE_POLL_MIN_SECS * 2;
+}
+
+/*
+ * We use hpss_StageCallBack() so that we do not block while the
+ * stage completes. We could use hpss_Open(O_NONBLOCK) and then
+ * hpss_Stage(BFS_ASYNCH_CALL) but then we block in hpss_Close().
+ */
+static int
+stage_mgr_issue(char * Pathname, u_signed64 DataLength)
+{
+	hpss_reqid_t reqid;
+	hpssoid_t    bitfile_id;
+
+	return hpss_StageCallBack(Pathname,
+	                          cast64m(0),
+	                          DataLength,
+	                          0,
+	                          NULL,
+	                          BFS_STAGE_ALL,
+	                          &reqid,
+	                          &bitfile_id);
+}
+
+static void *
+stage_mgr_thread(void * Arg)
+{
+	int                  rc;
+	time_t               now;
+	time_t               next_check;
+	hpssoid_t            bitfile_id;
+	u_signed64           data_length;
+	char                 pathname[HPSS_MAX_PATH_NAME];
+	globus_result_t      result;
+	stage_file_residency residency;
+	stage_request_t    * request;
+	bfidset_stats_t      stats;
+	struct timespec      timeout;
+
+	stage_mgr_lock();
+	while (_gStageMgr.Requests)
+	{
+		now        = time(NULL);
+		next_check = 0;
+
+		if (now >= _gStageMgr.NextExpire)
+		{
+			bfidset_expire(&_gStageMgr.Tracked, stage_mgr_expired, NULL);
+			_gStageMgr.NextExpire = now + STAGE_POLL_MAX_SECS;
+			continue;
+		}
+
+		/*
+		 * Find a request that is due to be checked or, while there is room,
+		 * one to issue.
+		 */
+		for (request = _gStageMgr.Requests; request; request = request->Next)
+		{
+			if (!request->Issued)
+			{
+				if (_gStageMgr.IssuedCnt < _gStageMgr.MaxIssued)
+					break;
+				continue;
+			}
+			if (request->NextCheck <= now)
+				break;
+			if (!next_check || request->NextCheck < next_check)
+				next_check = request->NextCheck;
+		}
+
+		if (!request)
+		{
+			if (!next_check || next_check > _gStageMgr.NextExpire)
+				next_check = _gStageMgr.NextExpire;
+
+			timeout.tv_sec  = next_check;
+			timeout.tv_nsec = 0;
+			pthread_cond_timedwait(&_gStageMgr.Wakeup, &_gStageMgr.Lock, &timeout);
+			continue;
+		}
+
+		bitfile_id  = request->BitfileId;
+		data_length = request->DataLength;
+		strncpy(pathname, request->Pathname, sizeof(pathname) - 1);
+		pathname[sizeof(pathname) - 1] = '\0';
+
+		if (!request->Issued)
+		{
+			stage_mgr_mark_issued(request);
+			bfidset_touch(&_gStageMgr.Tracked, &bitfile_id);
+			_gStageMgr.IssuedCnt++;
+
+			pthread_mutex_unlock(&_gStageMgr.Lock);
+			{
+				rc = stage_mgr_issue(pathname, data_length);
+			}
+			pthread_mutex_lock(&_gStageMgr.Lock);
+
+			if (rc != 0)
+			{
+				globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+				                       "HPSS DSI: stage of %s failed: %s\n",
+				                       pathname,
+				                       strerror(-rc));
+				/* It may have been dropped while we were unlocked. */
+				if ((request = stage_mgr_find(&bitfile_id)))
+					stage_mgr_remove(request);
+			}
+			continue;
+		}
+
+		pthread_mutex_unlock(&_gStageMgr.Lock);
+		{
+			result = stage_get_residency(pathname, &residency);
+		}
+		pthread_mutex_lock(&_gStageMgr.Lock);
+
+		/* It may have been dropped while we were unlocked. */
+		request = stage_mgr_find(&bitfile_id);
+		if (!request)
+			continue;
+
+		if (result || residency != STAGE_FILE_ARCHIVED)
+		{
+			if (result)
+				globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+				                       "HPSS DSI: lost track of the stage of %s\n",
+				                       pathname);
+			stage_mgr_remove(request);
+			continue;
+		}
+
+		request->NextCheck = time(NULL) + request->Interval;
+		request->Interval *= 2;
+		if (request->Interval > STAGE_POLL_MAX_SECS)
+			request->Interval = STAGE_POLL_MAX_SECS;
+	}
+	_gStageMgr.Running = 0;
+	pthread_mutex_unlock(&_gStageMgr.Lock);
+
+	bfidset_get_stats(&_gStageMgr.Tracked, &stats);
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	    "Stage manager idle: %llu stages tracked, %llu finished, %llu expired, "
+	    "%llu of %llu lookups found a stage\n",
+	    (unsigned long long)stats.Inserts,
+	    (unsigned long long)stats.Removes,
+	    (unsigned long long)stats.Expired,
+	    (unsigned long long)stats.Hits,
+	    (unsigned long long)stats.Lookups);
+
+	return NULL;
+}
+
+/* Called locked. Starts the manager thread or wakes it up. */
+static void
+stage_mgr_kick()
+{
+	int            rc = 0;
+	pthread_t      thread;
+	pthread_attr_t attr;
+
+	if (_gStageMgr.Running)
+	{
+		pthread_cond_signal(&_gStageMgr.Wakeup);
+		return;
+	}
+
+	if ((rc = pthread_attr_init(&attr)) == 0)
+	{
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		rc = pthread_create(&thread, &attr, stage_mgr_thread, NULL);
+		pthread_attr_destroy(&attr);
+	}
+
+	if (rc == 0)
+		_gStageMgr.Running = 1;
+	else
+		globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+		                       "HPSS DSI: can not start the stage manager: %s\n",
+		                       strerror(rc));
+}
+
+/*
+ * Starts staging the file unless the manager is already tracking a stage
+ * of it.
+ */
+static globus_result_t
+stage_mgr_submit(char * Pathname, hpss_xfileattr_t * XFileAttr)
+{
+	int               rc      = 0;
+	int               retval  = 0;
+	stage_request_t * request = NULL;
+
+	GlobusGFSName(stage_mgr_submit);
+
+	request = stage_mgr_new_request(Pathname,
+	                                &XFileAttr->Attrs.BitfileId,
+	                                XFileAttr->Attrs.DataLength);
+	if (!request)
+		return GlobusGFSErrorMemory("stage_request_t");
+
+	/* Claim the file before staging it so only one of us issues the stage. */
+	stage_mgr_lock();
+	{
+		stage_mgr_mark_issued(request);
+		rc = stage_mgr_append(request);
+	}
+	pthread_mutex_unlock(&_gStageMgr.Lock);
+
+	if (rc)
+	{
+		stage_mgr_free_request(request);
+		if (rc < 0)
+			return GlobusGFSErrorMemory("bfidset_entry_t");
+		return GLOBUS_SUCCESS;
+	}
+
+	retval = stage_mgr_issue(Pathname, XFileAttr->Attrs.DataLength);
+
+	stage_mgr_lock();
+	{
+		if (retval != 0)
+		{
+			if ((request = stage_mgr_find(&XFileAttr->Attrs.BitfileId)))
+				stage_mgr_remove(request);
+		} else
+		{
+			stage_mgr_kick();
+		}
+	}
+	pthread_mutex_unlock(&_gStageMgr.Lock);
+
+	if (retval != 0)
+		return GlobusGFSErrorSystemError("hpss_StageCallBack()", -retval);
+	return GLOBUS_SUCCESS;
+}
+
+int
+stage_mgr_is_staging(hpssoid_t * BitfileId)
+{
+	/* The set has its own locks. */
+	pthread_once(&_gStageMgrOnce, stage_mgr_init);
+	return bfidset_lookup(&_gStageMgr.Tracked, BitfileId) != NULL;
+}
+
+/*
+ * Sleeps until the manager is done with the file or Deadline passes.
+ * Returns 1 if it finished.
+ */
+static int
+stage_mgr_wait(hpssoid_t * BitfileId, time_t Deadline)
+{
+	int             finished = 0;
+	struct timespec deadline;
+
+	deadline.tv_sec  = Deadline;
+	deadline.tv_nsec = 0;
+
+	stage_mgr_lock();
+	{
+		while (stage_mgr_find(BitfileId) && time(NULL) < Deadline)
+		{
+			pthread_cond_timedwait(&_gStageMgr.Changed, &_gStageMgr.Lock, &deadline);
+		}
+		finished = (stage_mgr_find(BitfileId) == NULL);
+	}
+	pthread_mutex_unlock(&_gStageMgr.Lock);
+
+	return finished;
+}
+
 globus_result_t
-stage_file(char * Pathname, int Timeout, stage_file_residency * Residency)
+stage_start(char                 * Pathname,
+            hpssoid_t            * BitfileId,
+            stage_file_residency * Residency)
 {
 	globus_result_t  result = GLOBUS_SUCCESS;
 	hpss_xfileattr_t xfileattr;
-	hpss_reqid_t     reqid;
-	hpssoid_t        bitfile_id;
-	time_t           start_time = time(NULL);
 	int              retval;
 
-	GlobusGFSName(stage_file);
+	GlobusGFSName(stage_start);
 
 	memset(&xfileattr, 0, sizeof(hpss_xfileattr_t));
 
@@ -269,62 +657,35 @@ stage_file(char * Pathname, int Timeout, stage_file_residency * Residency)
 
 	stage_check_residency(&xfileattr, Residency);
 
-	switch (*Residency)
-	{
-	case STAGE_FILE_RESIDENT:
-		stage_rm_bfid_from_list(&xfileattr.Attrs.BitfileId);
-	case STAGE_FILE_TAPE_ONLY:
+	if (*Residency != STAGE_FILE_ARCHIVED)
 		goto cleanup;
-	case STAGE_FILE_ARCHIVED:
-		break;
-	}
 
-	/*
-	 * Need to stage file.
-	 */
+	/* Need to stage file. The manager tracks it from here on. */
+	*BitfileId = xfileattr.Attrs.BitfileId;
+	result = stage_mgr_submit(Pathname, &xfileattr);
 
-	if (stage_check_bfid_in_list(&xfileattr.Attrs.BitfileId))
-		goto cleanup;
+cleanup:
+	stage_free_xfileattr(&xfileattr);
+	return result;
+}
 
-	/*
-	 * We use hpss_StageCallBack() so that we do not block while the
-	 * stage completes. We could use hpss_Open(O_NONBLOCK) and then
-	 * hpss_Stage(BFS_ASYNCH_CALL) but then we block in hpss_Close().
-	 */
-	retval = hpss_StageCallBack(Pathname,
-	                            cast64m(0),
-	                            xfileattr.Attrs.DataLength,
-	                            0,
-	                            NULL,
-	                            BFS_STAGE_ALL,
-	                            &reqid,
-	                            &bitfile_id);
-	if (retval != 0)
-	{
-		result = GlobusGFSErrorSystemError("hpss_StageCallBack()", -retval);
-		goto cleanup;
-	}
+globus_result_t
+stage_file(char * Pathname, int Timeout, stage_file_residency * Residency)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+	hpssoid_t       bitfile_id;
 
-	/* Now wait for the given about of time or the file staged. */
-	while ((time(NULL) - start_time) < Timeout && *Residency == STAGE_FILE_ARCHIVED)
-	{
-		// Sleep for 1.0 sec
-		struct timeval tv;
-		tv.tv_sec  = 1;
-		tv.tv_usec = 0;
-		select(0, NULL, NULL, NULL, &tv);
+	result = stage_start(Pathname, &bitfile_id, Residency);
+	if (result || *Residency != STAGE_FILE_ARCHIVED)
+		return result;
 
+	/*
+	 * This session only sleeps until the manager sees the stage finish or
+	 * the timeout passes.
+	 */
+	if (Timeout > 0 && stage_mgr_wait(&bitfile_id, time(NULL) + Timeout))
 		result = stage_get_residency(Pathname, Residency);
-		if (result)
-			goto cleanup;
-	}
 
-	stage_check_residency(&xfileattr, Residency);
-	if (*Residency != STAGE_FILE_ARCHIVED)
-		stage_add_bfid_to_list(&xfileattr.Attrs.BitfileId);
-
-cleanup:
-	stage_free_xfileattr(&xfileattr);
 	return result;
 }
 
@@ -373,3 +734,334 @@ cleanup:
 	if (command_output)
 		globus_free(command_output);
 }
+
+/*
+ * Batch staging. The manifest is a file in HPSS listing one path per line;
+ * relative paths are taken from the manifest's directory and blank lines
+ * and lines starting with '#' are skipped.
+ */
+typedef struct {
+	char     * Pathname;
+	hpssoid_t  BitfileId;
+	u_signed64 DataLength;
+	int        OnTape;     // VVID and positions are valid
+	hpssoid_t  VVID;
+	u_signed64 RelPosition;
+	u_signed64 RelPositionOffset;
+} stage_batch_entry_t;
+
+static globus_result_t
+stage_read_manifest(char * Pathname, char ** Manifest)
+{
+	int             fd     = -1;
+	ssize_t         count  = 0;
+	size_t          length = 0;
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	GlobusGFSName(stage_read_manifest);
+
+	*Manifest = malloc(STAGE_MANIFEST_MAX + 1);
+	if (!*Manifest)
+		return GlobusGFSErrorMemory("stage manifest");
+
+	fd = hpss_Open(Pathname, O_RDONLY, 0, NULL, NULL, NULL);
+	if (fd < 0)
+	{
+		result = GlobusGFSErrorSystemError("hpss_Open", -fd);
+		goto cleanup;
+	}
+
+	/* Read one byte past the limit to tell if it is too large. */
+	while (length <= STAGE_MANIFEST_MAX)
+	{
+		count = hpss_Read(fd, *Manifest + length, STAGE_MANIFEST_MAX + 1 - length);
+		if (count < 0)
+		{
+			result = GlobusGFSErrorSystemError("hpss_Read", -count);
+			goto cleanup;
+		}
+		if (count == 0)
+			break;
+		length += count;
+	}
+
+	if (length > STAGE_MANIFEST_MAX)
+	{
+		result = GlobusGFSErrorGeneric("Stage manifest is too large");
+		goto cleanup;
+	}
+	(*Manifest)[length] = '\0';
+
+cleanup:
+	if (fd >= 0)
+		hpss_Close(fd);
+	if (result)
+	{
+		free(*Manifest);
+		*Manifest = NULL;
+	}
+	return result;
+}
+
+/* Finds where the file's data starts on its first tape level. */
+static void
+stage_get_tape_position(hpss_xfileattr_t * XFileAttr, stage_batch_entry_t * Entry)
+{
+	int storage_level = 0;
+
+	for (storage_level = 0; storage_level < HPSS_MAX_STORAGE_LEVELS; storage_level++)
+	{
+		if (!(XFileAttr->SCAttrib[storage_level].Flags & BFS_BFATTRS_LEVEL_IS_TAPE))
+			continue;
+		if (XFileAttr->SCAttrib[storage_level].NumberOfVVs == 0)
+			continue;
+
+		Entry->OnTape            = 1;
+		Entry->VVID              = XFileAttr->SCAttrib[storage_level].VVAttrib[0].VVID;
+		Entry->RelPosition       = XFileAttr->SCAttrib[storage_level].VVAttrib[0].RelPosition;
+		Entry->RelPositionOffset = XFileAttr->SCAttrib[storage_level].VVAttrib[0].RelPositionOffset;
+		return;
+	}
+}
+
+/* Groups files by volume, in on-tape order within each volume. */
+static int
+stage_compare_tape_order(const void * A, const void * B)
+{
+	int                         rc = 0;
+	const stage_batch_entry_t * a  = A;
+	const stage_batch_entry_t * b  = B;
+
+	if (a->OnTape != b->OnTape)
+		return b->OnTape - a->OnTape;
+	if (!a->OnTape)
+		return 0;
+
+	rc = memcmp(&a->VVID, &b->VVID, sizeof(hpssoid_t));
+	if (rc)
+		return rc;
+
+	if (gt64(a->RelPosition, b->RelPosition))
+		return 1;
+	if (gt64(b->RelPosition, a->RelPosition))
+		return -1;
+	if (gt64(a->RelPositionOffset, b->RelPositionOffset))
+		return 1;
+	if (gt64(b->RelPositionOffset, a->RelPositionOffset))
+		return -1;
+	return 0;
+}
+
+void
+stage_batch(globus_gfs_operation_t      Operation,
+            globus_gfs_command_info_t * CommandInfo,
+            config_t                  * Config,
+            commands_callback           Callback)
+{
+	int                   i              = 0;
+	int                   retval         = 0;
+	int                   timeout        = 0;
+	int                   entry_cnt      = 0;
+	int                   entry_max      = 0;
+	int                   resident_cnt   = 0;
+	int                   tape_only_cnt  = 0;
+	int                   failed_cnt     = 0;
+	int                   staging_cnt    = 0;
+	int                   staged_cnt     = 0;
+	time_t                deadline       = 0;
+	char                * manifest_path  = NULL;
+	char                * manifest       = NULL;
+	char                * line           = NULL;
+	char                * next_line      = NULL;
+	char                * command_output = NULL;
+	char                * slash          = NULL;
+	char                  pathname[HPSS_MAX_PATH_NAME];
+	stage_batch_entry_t * entries        = NULL;
+	stage_batch_entry_t * new_entries    = NULL;
+	stage_file_residency  residency;
+	hpss_xfileattr_t      xfileattr;
+	globus_result_t       result;
+
+	GlobusGFSName(stage_batch);
+
+	result = stage_get_timeout(Operation, CommandInfo, &timeout);
+	if (result)
+		goto cleanup;
+
+	manifest_path = CommandInfo->pathname;
+	result = stage_read_manifest(manifest_path, &manifest);
+	if (result)
+		goto cleanup;
+
+	slash = strrchr(manifest_path, '/');
+
+	/*
+	 * Collect the residency and tape position of each file.
+	 */
+	for (line = manifest; line && *line; line = next_line)
+	{
+		next_line = strchr(line, '\n');
+		if (next_line)
+			*next_line++ = '\0';
+		if (*line && line[strlen(line) - 1] == '\r')
+			line[strlen(line) - 1] = '\0';
+		if (*line == '\0' || *line == '#')
+			continue;
+
+		if (*line == '/' || !slash)
+			retval = snprintf(pathname, sizeof(pathname), "%s", line);
+		else
+			retval = snprintf(pathname, sizeof(pathname), "%.*s/%s",
+			                  (int)(slash - manifest_path), manifest_path, line);
+		if (retval >= sizeof(pathname))
+		{
+			failed_cnt++;
+			continue;
+		}
+
+		memset(&xfileattr, 0, sizeof(hpss_xfileattr_t));
+		retval = hpss_FileGetXAttributes(pathname,
+		                                 API_GET_STATS_FOR_ALL_LEVELS|API_GET_XATTRS_NO_BLOCK,
+		                                 0,
+		                                 &xfileattr);
+		if (retval)
+		{
+			globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+			                       "HPSS DSI: can not stage %s: %s\n",
+			                       pathname,
+			                       strerror(-retval));
+			failed_cnt++;
+			continue;
+		}
+
+		stage_check_residency(&xfileattr, &residency);
+		switch (residency)
+		{
+		case STAGE_FILE_RESIDENT:
+			resident_cnt++;
+			break;
+		case STAGE_FILE_TAPE_ONLY:
+			tape_only_cnt++;
+			break;
+		case STAGE_FILE_ARCHIVED:
+			if (entry_cnt == entry_max)
+			{
+				entry_max   = entry_max ? entry_max * 2 : 64;
+				new_entries = realloc(entries, sizeof(stage_batch_entry_t) * entry_max);
+				if (!new_entries)
+				{
+					stage_free_xfileattr(&xfileattr);
+					result = GlobusGFSErrorMemory("stage_batch_entry_t");
+					goto cleanup;
+				}
+				entries = new_entries;
+			}
+
+			memset(&entries[entry_cnt], 0, sizeof(stage_batch_entry_t));
+			entries[entry_cnt].Pathname = strdup(pathname);
+			if (!entries[entry_cnt].Pathname)
+			{
+				stage_free_xfileattr(&xfileattr);
+				result = GlobusGFSErrorMemory("stage pathname");
+				goto cleanup;
+			}
+			entries[entry_cnt].BitfileId  = xfileattr.Attrs.BitfileId;
+			entries[entry_cnt].DataLength = xfileattr.Attrs.DataLength;
+			stage_get_tape_position(&xfileattr, &entries[entry_cnt]);
+			entry_cnt++;
+			break;
+		}
+
+		stage_free_xfileattr(&xfileattr);
+	}
+
+	/*
+	 * Queue the stages in tape order. The manager issues them, keeping at
+	 * most BatchStageConcurrency outstanding.
+	 */
+	qsort(entries, entry_cnt, sizeof(stage_batch_entry_t), stage_compare_tape_order);
+
+	stage_mgr_lock();
+	{
+		_gStageMgr.MaxIssued = Config->BatchStageConcurrency;
+
+		for (i = 0; i < entry_cnt; i++)
+		{
+			int               rc      = 0;
+			stage_request_t * request = NULL;
+
+			request = stage_mgr_new_request(entries[i].Pathname,
+			                                &entries[i].BitfileId,
+			                                entries[i].DataLength);
+			if (request)
+				rc = stage_mgr_append(request);
+
+			/* Already being staged, or out of memory. */
+			if (request && rc)
+				stage_mgr_free_request(request);
+
+			if (!request || rc < 0)
+			{
+				result = GlobusGFSErrorMemory("stage_request_t");
+				break;
+			}
+		}
+
+		if (entry_cnt)
+			stage_mgr_kick();
+	}
+	pthread_mutex_unlock(&_gStageMgr.Lock);
+
+	if (result)
+		goto cleanup;
+
+	/*
+	 * Wait, up to the timeout, for the whole batch. The manager also lets
+	 * go of stages that failed or that it lost track of, so check that
+	 * each one really is on disk.
+	 */
+	deadline = time(NULL) + timeout;
+	for (i = 0; i < entry_cnt; i++)
+	{
+		if (timeout <= 0 || !stage_mgr_wait(&entries[i].BitfileId, deadline))
+		{
+			staging_cnt++;
+			continue;
+		}
+
+		if (stage_get_residency(entries[i].Pathname, &residency) == GLOBUS_SUCCESS &&
+		    residency == STAGE_FILE_RESIDENT)
+		{
+			staged_cnt++;
+			continue;
+		}
+
+		globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+		                       "HPSS DSI: stage of %s did not complete\n",
+		                       entries[i].Pathname);
+		failed_cnt++;
+	}
+
+	command_output = globus_common_create_string(
+	    "%d BATCHSTAGE %s: %d resident, %d tape only, %d staged, %d being retrieved, %d failed.\r\n",
+	    staging_cnt ? 450 : 250,
+	    manifest_path,
+	    resident_cnt,
+	    tape_only_cnt,
+	    staged_cnt,
+	    staging_cnt,
+	    failed_cnt);
+
+cleanup:
+	Callback(Operation, result, command_output);
+	if (command_output)
+		globus_free(command_output);
+	for (i = 0; i < entry_cnt; i++)
+	{
+		free(entries[i].Pathname);
+	}
+	if (entries)
+		free(entries);
+	if (manifest)
+		free(manifest);
+}
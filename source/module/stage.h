@@ -46,6 +46,11 @@
  */
 #include <globus_gridftp_server.h>
 
+/*
+ * HPSS includes
+ */
+#include <hpss_api.h>
+
 /*
  * Local includes
  */
@@ -58,9 +63,45 @@ typedef enum {
 	STAGE_FILE_ARCHIVED,
 } stage_file_residency;
 
+/*
+ * The stage manager checks each file it is staging after STAGE_POLL_MIN_SECS,
+ * doubling the interval up to STAGE_POLL_MAX_SECS. It stops tracking a stage
+ * STAGE_TRACK_SECS after it was issued (or queued, if it never was); a later
+ * SITE STAGE of the file stages it again.
+ */
+#define STAGE_POLL_MIN_SECS 1
+#define STAGE_POLL_MAX_SECS 15
+#define STAGE_TRACK_SECS    (24*60*60)
+
+/* Returns 1 while the stage manager is staging the file. */
+int
+stage_mgr_is_staging(hpssoid_t * BitfileId);
+
+/*
+ * Hands the file to the stage manager if it is archived and returns without
+ * waiting. BitfileId is set when Residency is STAGE_FILE_ARCHIVED; poll it
+ * with stage_mgr_is_staging().
+ */
+globus_result_t
+stage_start(char                 * Pathname,
+            hpssoid_t            * BitfileId,
+            stage_file_residency * Residency);
+
 void
 stage(globus_gfs_operation_t      Operation,
       globus_gfs_command_info_t * CommandInfo,
       commands_callback           Callback);
 
+#define STAGE_MANIFEST_MAX (16*1024*1024)
+
+/*
+ * SITE BATCHSTAGE <timeout> <manifest>. Stages every file listed in the
+ * manifest, in tape order.
+ */
+void
+stage_batch(globus_gfs_operation_t      Operation,
+            globus_gfs_command_info_t * CommandInfo,
+            config_t                  * Config,
+            commands_callback           Callback);
+
 #endif /* HPSS_DSI_STAGE_H */
@@ -55,6 +55,9 @@
  * Local includes
  */
 #include "stat.h"
+#include "arena.h"
+#include "workers.h"
+#include "attrcache.h"
 
 globus_result_t
 stat_translate_stat(char              * Pathname,
@@ -124,20 +127,20 @@ stat_translate_stat(char              * Pathname,
  * symlink information if the link is broken.
  */
 globus_result_t
-stat_object(char * Pathname, globus_gfs_stat_t * GFSStat)
+stat_object(char * Pathname, globus_gfs_stat_t * GFSStat, attrcache_t * Cache)
 {
 	GlobusGFSName(stat_object);
 
 	memset(GFSStat, 0, sizeof(globus_gfs_stat_t));
 
 	hpss_stat_t hpss_stat_buf;
-	int retval = hpss_Lstat(Pathname, &hpss_stat_buf);
+	int retval = attrcache_lstat(Cache, Pathname, &hpss_stat_buf);
 	if (retval)
 		return GlobusGFSErrorSystemError("hpss_Lstat", -retval);
 
 	if (S_ISLNK(hpss_stat_buf.st_mode))
 	{
-		retval = hpss_Stat(Pathname, &hpss_stat_buf);
+		retval = attrcache_stat(Cache, Pathname, &hpss_stat_buf);
 		if (retval && retval != -ENOENT)
 			return GlobusGFSErrorSystemError("hpss_Stat", -retval);
 	}
@@ -146,24 +149,37 @@ stat_object(char * Pathname, globus_gfs_stat_t * GFSStat)
 }
 
 globus_result_t
-stat_link(char * Pathname, globus_gfs_stat_t * GFSStat)
+stat_link(char * Pathname, globus_gfs_stat_t * GFSStat, attrcache_t * Cache)
 {
 	GlobusGFSName(stat_link);
 
 	memset(GFSStat, 0, sizeof(globus_gfs_stat_t));
 
 	hpss_stat_t hpss_stat_buf;
-	int retval = hpss_Lstat(Pathname, &hpss_stat_buf);
+	int retval = attrcache_lstat(Cache, Pathname, &hpss_stat_buf);
 	if (retval)
 		return GlobusGFSErrorSystemError("hpss_Lstat", -retval);
 
 	return stat_translate_stat(Pathname, &hpss_stat_buf, GFSStat);
 }
 
+/* Strings come from Arena if given, otherwise they are malloc'd. */
+static char *
+stat_strdup(arena_t * Arena, const char * String)
+{
+	if (Arena)
+		return arena_strdup(Arena, String);
+	return globus_libc_strdup(String);
+}
+
+/*
+ * Symlink targets are filled in separately by stat_translate_dir_entries().
+ */
 globus_result_t
 stat_translate_dir_entry(ns_ObjHandle_t    * ParentObjHandle,
                          ns_DirEntry_t     * DirEntry,
-                         globus_gfs_stat_t * GFSStat)
+                         globus_gfs_stat_t * GFSStat,
+                         arena_t           * Arena)
 {
 	GlobusGFSName(stat_translate_dir_entry);
 
@@ -225,33 +241,230 @@ stat_translate_dir_entry(ns_ObjHandle_t    * ParentObjHandle,
 	GFSStat->size  = DirEntry->Attrs.DataLength;
 
 
-	GFSStat->name = globus_libc_strdup(DirEntry->Name);
+	GFSStat->name = stat_strdup(Arena, DirEntry->Name);
 	if (!GFSStat->name)
 		return GlobusGFSErrorMemory("GFSStat->name");
 
-	/* If it is a symbolic link... */
-	if (DirEntry->Attrs.Type == NS_OBJECT_TYPE_SYM_LINK)
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Reads the target of a symlink entry. Lock, if given, protects Arena
+ * while the target is copied out.
+ */
+static globus_result_t
+stat_read_dir_link(ns_ObjHandle_t    * ParentObjHandle,
+                   ns_DirEntry_t     * DirEntry,
+                   globus_gfs_stat_t * GFSStat,
+                   arena_t           * Arena,
+                   pthread_mutex_t   * Lock)
+{
+	int  retval;
+	char symlink_target[HPSS_MAX_PATH_NAME];
+
+	GlobusGFSName(stat_read_dir_link);
+
+	/* Read the target. */
+	retval = hpss_ReadlinkHandle(ParentObjHandle,
+	                             DirEntry->Name,
+	                             symlink_target,
+	                             sizeof(symlink_target),
+	                             NULL);
+	if (retval < 0)
+		return GlobusGFSErrorSystemError("hpss_ReadlinkHandle", -retval);
+
+	/* Copy out the symlink target. */
+	if (Lock) pthread_mutex_lock(Lock);
+	GFSStat->symlink_target = stat_strdup(Arena, symlink_target);
+	if (Lock) pthread_mutex_unlock(Lock);
+
+	if (GFSStat->symlink_target == NULL)
+		return GlobusGFSErrorMemory("SymlinkTarget");
+	return GLOBUS_SUCCESS;
+}
+
+/* Shared by the threads resolving one batch's symlinks. */
+typedef struct {
+	pthread_mutex_t     Lock;
+	pthread_cond_t      Cond;
+	ns_ObjHandle_t    * ParentObjHandle;
+	ns_DirEntry_t     * DirEntries;
+	globus_gfs_stat_t * GFSStatArray;
+	uint32_t            Count;
+	uint32_t            NextIndex;
+	arena_t           * Arena;
+	int                 Running;
+	globus_result_t     Result;
+} stat_links_t;
+
+static void *
+stat_links_thread(void * Arg)
+{
+	uint32_t        i      = 0;
+	stat_links_t  * links  = Arg;
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	while (1)
 	{
-		char symlink_target[HPSS_MAX_PATH_NAME];
-		/* Read the target. */
-		int retval = hpss_ReadlinkHandle(ParentObjHandle,
-		                                 DirEntry->Name, 
-		                                 symlink_target, 
-		                                 sizeof(symlink_target),
-		                                 NULL);
+		pthread_mutex_lock(&links->Lock);
+		{
+			if (!result && !links->Result)
+			{
+				while (links->NextIndex < links->Count &&
+				       links->DirEntries[links->NextIndex].Attrs.Type != NS_OBJECT_TYPE_SYM_LINK)
+				{
+					links->NextIndex++;
+				}
+			}
+
+			if (result && !links->Result)
+				links->Result = result;
+
+			if (links->Result || links->NextIndex == links->Count)
+			{
+				if (--links->Running == 0)
+					pthread_cond_signal(&links->Cond);
+				pthread_mutex_unlock(&links->Lock);
+				return NULL;
+			}
+			i = links->NextIndex++;
+		}
+		pthread_mutex_unlock(&links->Lock);
 
-		if (retval < 0)
+		result = stat_read_dir_link(links->ParentObjHandle,
+		                            &links->DirEntries[i],
+		                            &links->GFSStatArray[i],
+		                            links->Arena,
+		                            &links->Lock);
+	}
+	return NULL;
+}
+
+/*
+ * Resolves the batch's symlinks on up to Threads pool workers. Falls back
+ * to this thread if that many workers aren't free right now; the listing
+ * should not wait behind running transfers.
+ */
+static globus_result_t
+stat_read_dir_links(ns_ObjHandle_t    * ParentObjHandle,
+                    ns_DirEntry_t     * DirEntries,
+                    uint32_t            Count,
+                    globus_gfs_stat_t * GFSStatArray,
+                    arena_t           * Arena,
+                    int                 Threads)
+{
+	int               i       = 0;
+	int               nlinks  = 0;
+	int               started = 0;
+	workers_group_t * group   = NULL;
+	globus_result_t   result  = GLOBUS_SUCCESS;
+	stat_links_t      links;
+
+	for (i = 0; i < Count; i++)
+	{
+		if (DirEntries[i].Attrs.Type == NS_OBJECT_TYPE_SYM_LINK)
+			nlinks++;
+	}
+	if (Threads > nlinks)
+		Threads = nlinks;
+
+	if (Threads > 1)
+	{
+		memset(&links, 0, sizeof(links));
+		pthread_mutex_init(&links.Lock, NULL);
+		pthread_cond_init(&links.Cond, NULL);
+		links.ParentObjHandle = ParentObjHandle;
+		links.DirEntries      = DirEntries;
+		links.GFSStatArray    = GFSStatArray;
+		links.Count           = Count;
+		links.Arena           = Arena;
+		links.Running         = Threads;
+
+		result = workers_group_init(&group);
+		for (i = 0; !result && i < Threads; i++)
 		{
-			stat_destroy(GFSStat);
-			return GlobusGFSErrorSystemError("hpss_ReadlinkHandle", -retval);
+			result = workers_group_add(group, stat_links_thread, &links);
 		}
+		if (result)
+			workers_group_destroy(group);
+		else
+			started = workers_submit_now(group);
 
-		/* Copy out the symlink target. */
-		GFSStat->symlink_target = globus_libc_strdup(symlink_target);
-		if (GFSStat->symlink_target == NULL)
+		if (started)
 		{
-			stat_destroy(GFSStat);
-			return GlobusGFSErrorMemory("SymlinkTarget");
+			pthread_mutex_lock(&links.Lock);
+			while (links.Running > 0)
+			{
+				pthread_cond_wait(&links.Cond, &links.Lock);
+			}
+			pthread_mutex_unlock(&links.Lock);
+		}
+
+		pthread_cond_destroy(&links.Cond);
+		pthread_mutex_destroy(&links.Lock);
+
+		if (result)
+			return result;
+		if (started)
+			return links.Result;
+	}
+
+	for (i = 0; i < Count; i++)
+	{
+		if (DirEntries[i].Attrs.Type != NS_OBJECT_TYPE_SYM_LINK)
+			continue;
+
+		result = stat_read_dir_link(ParentObjHandle,
+		                            &DirEntries[i],
+		                            &GFSStatArray[i],
+		                            Arena,
+		                            NULL);
+		if (result)
+			return result;
+	}
+	return GLOBUS_SUCCESS;
+}
+
+globus_result_t
+stat_translate_dir_entries(ns_ObjHandle_t    * ParentObjHandle,
+                           ns_DirEntry_t     * DirEntries,
+                           uint32_t            Count,
+                           globus_gfs_stat_t * GFSStatArray,
+                           arena_t           * Arena,
+                           int                 SymlinkThreads)
+{
+	int             i;
+	globus_result_t result;
+
+	GlobusGFSName(stat_translate_dir_entries);
+
+	memset(GFSStatArray, 0, sizeof(globus_gfs_stat_t)*Count);
+
+	for (i = 0; i < Count; i++)
+	{
+		result = stat_translate_dir_entry(ParentObjHandle,
+		                                  &DirEntries[i],
+		                                  &GFSStatArray[i],
+		                                  Arena);
+		if (result)
+		{
+			if (!Arena) stat_destroy_array(GFSStatArray, i);
+			return result;
+		}
+	}
+
+	if (SymlinkThreads > 0)
+	{
+		result = stat_read_dir_links(ParentObjHandle,
+		                             DirEntries,
+		                             Count,
+		                             GFSStatArray,
+		                             Arena,
+		                             SymlinkThreads);
+		if (result)
+		{
+			if (!Arena) stat_destroy_array(GFSStatArray, Count);
+			return result;
 		}
 	}
 	return GLOBUS_SUCCESS;
@@ -267,7 +480,6 @@ stat_directory_entries(ns_ObjHandle_t    * ObjHandle,       // IN
                        uint32_t          * GFSStatCountOut) // OUT
 {
 	globus_result_t result;
-	int i;
 	int retval;
 
 	GlobusGFSName(stat_directory_entries);
@@ -295,18 +507,14 @@ stat_directory_entries(ns_ObjHandle_t    * ObjHandle,       // IN
 	}
 
 	*GFSStatCountOut = retval;
-	for (i = 0; i < *GFSStatCountOut; i++)
-	{
-		result = stat_translate_dir_entry(ObjHandle, &dir_entry_buffer[i], &GFSStatArray[i]);
-		if (result)
-		{
-			stat_destroy_array(GFSStatArray, i);
-			free(dir_entry_buffer);
-			return result;
-		}
-	}
-
-	return GLOBUS_SUCCESS;
+	result = stat_translate_dir_entries(ObjHandle,
+	                                    dir_entry_buffer,
+	                                    *GFSStatCountOut,
+	                                    GFSStatArray,
+	                                    NULL,
+	                                    1);
+	free(dir_entry_buffer);
+	return result;
 }
 
 void
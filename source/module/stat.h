@@ -51,11 +51,34 @@
  */
 #include <ns_ObjHandle.h>
 
+/*
+ * Local includes
+ */
+#include "arena.h"
+#include "attrcache.h"
+
+/* Cache may be NULL. */
+globus_result_t
+stat_object(char * Pathname, globus_gfs_stat_t *, attrcache_t * Cache);
+
 globus_result_t
-stat_object(char * Pathname, globus_gfs_stat_t *);
+stat_link(char * Pathname, globus_gfs_stat_t *, attrcache_t * Cache);
 
+/*
+ * Translates Count entries read with hpss_ReadAttrsHandle(). If Arena is
+ * given, names and symlink targets come from it and the entries must not
+ * be passed to stat_destroy(); otherwise they are malloc'd.
+ *
+ * Symlink targets are read with up to SymlinkThreads threads at once. If
+ * SymlinkThreads is 0, targets are not read at all.
+ */
 globus_result_t
-stat_link(char * Pathname, globus_gfs_stat_t *);
+stat_translate_dir_entries(ns_ObjHandle_t    * ParentObjHandle,
+                           ns_DirEntry_t     * DirEntries,
+                           uint32_t            Count,
+                           globus_gfs_stat_t * GFSStatArray,
+                           arena_t           * Arena,
+                           int                 SymlinkThreads);
 
 globus_result_t
 stat_directory_entries(ns_ObjHandle_t    * ObjHandle,        // IN
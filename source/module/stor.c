@@ -53,6 +53,7 @@
 #include "stor.h"
 #include "cksm.h"
 #include "pio.h"
+#include "blocksize.h"
 
 globus_result_t
 stor_can_change_cos(char * Pathname, int * can_change_cos)
@@ -89,7 +90,8 @@ stor_open_for_writing(char        * Pathname,
                       globus_off_t  AllocSize,
                       globus_bool_t Truncate,
                       int         * FileFD,
-                      int         * FileStripeWidth)
+                      int         * FileStripeWidth,
+                      globus_off_t* OptimumAccessSize)
 {
 	int                     oflags      = 0;
 	int                     retval      = 0;
@@ -182,6 +184,7 @@ stor_open_for_writing(char        * Pathname,
 
 	/* Copy out the file stripe width. */
 	*FileStripeWidth = hints_out.StripeWidth;
+	CONVERT_U64_TO_LONGLONG(hints_out.OptimumAccessSize, *OptimumAccessSize);
 
 cleanup:
 	if (result)
@@ -194,6 +197,96 @@ cleanup:
 	return result;
 }
 
+/* Called locked. */
+static void
+stor_free_buffer_push(stor_info_t * StorInfo, stor_buffer_t * StorBuffer)
+{
+	StorBuffer->Next      = StorInfo->FreeBuffers;
+	StorInfo->FreeBuffers = StorBuffer;
+	StorInfo->FreeBufferCnt++;
+}
+
+/* Called locked. */
+static stor_buffer_t *
+stor_free_buffer_pop(stor_info_t * StorInfo)
+{
+	stor_buffer_t * stor_buffer = StorInfo->FreeBuffers;
+
+	if (stor_buffer)
+	{
+		StorInfo->FreeBuffers = stor_buffer->Next;
+		StorInfo->FreeBufferCnt--;
+	}
+	return stor_buffer;
+}
+
+static stor_buffer_t **
+stor_ready_bucket(stor_info_t * StorInfo, globus_off_t TransferOffset)
+{
+	return &StorInfo->ReadyBuffers[(TransferOffset / StorInfo->BlockSize) % STOR_READY_TABLE_SIZE];
+}
+
+/* Called locked. */
+static void
+stor_ready_buffer_insert(stor_info_t * StorInfo, stor_buffer_t * StorBuffer)
+{
+	stor_buffer_t ** bucket = stor_ready_bucket(StorInfo, StorBuffer->TransferOffset);
+
+	StorBuffer->Next = *bucket;
+	*bucket          = StorBuffer;
+	StorInfo->ReadyBufferCnt++;
+}
+
+/* Called locked. */
+static void
+stor_ready_buffer_remove(stor_info_t * StorInfo, stor_buffer_t * StorBuffer)
+{
+	stor_buffer_t ** entry = stor_ready_bucket(StorInfo, StorBuffer->TransferOffset);
+
+	while (*entry && *entry != StorBuffer)
+		entry = &(*entry)->Next;
+
+	assert(*entry == StorBuffer);
+
+	*entry = StorBuffer->Next;
+	StorInfo->ReadyBufferCnt--;
+}
+
+/* Called locked. Returns the ready buffer starting at Offset, or NULL. */
+static stor_buffer_t *
+stor_find_buffer(stor_info_t * StorInfo, globus_off_t Offset)
+{
+	stor_buffer_t * stor_buffer = *stor_ready_bucket(StorInfo, Offset);
+
+	while (stor_buffer && stor_buffer->TransferOffset != Offset)
+		stor_buffer = stor_buffer->Next;
+
+	return stor_buffer;
+}
+
+/* The hasher is done with a data channel buffer. */
+static void
+stor_hash_released(void * Arg, char * Buffer)
+{
+	stor_buffer_t * stor_buffer = Arg;
+	stor_info_t   * stor_info   = stor_buffer->StorInfo;
+
+	pthread_mutex_lock(&stor_info->Mutex);
+	{
+		stor_buffer->HashPending = 0;
+
+		/* PIO may have taken all of its data already. */
+		if (stor_buffer->BufferLength == 0)
+		{
+			stor_info->HashDrainCnt--;
+			stor_free_buffer_push(stor_info, stor_buffer);
+		}
+
+		pthread_cond_broadcast(&stor_info->Cond);
+	}
+	pthread_mutex_unlock(&stor_info->Mutex);
+}
+
 void
 stor_gridftp_callout(globus_gfs_operation_t Operation,
                      globus_result_t        Result,
@@ -227,32 +320,40 @@ assert(Length  <= stor_info->BlockSize);
 		stor_buffer->TransferOffset = Offset;
 		stor_buffer->BufferLength   = Length;
 
+		/*
+		 * Hash the data where it landed. The buffer is not reused until the
+		 * hasher hands it back. A failure here only costs us the stored
+		 * checksum; stor_transfer_complete_callback() will see it from
+		 * hasher_finish().
+		 */
+		if (Length && stor_info->Hasher && !stor_info->Result &&
+		    hasher_submit_shared(stor_info->Hasher,
+		                         stor_buffer->Buffer,
+		                         Length,
+		                         Offset,
+		                         stor_hash_released,
+		                         stor_buffer) == GLOBUS_SUCCESS)
+		{
+			stor_buffer->HashPending = 1;
+		}
+
 		/* Stor the buffer. */
+		if (Length && stor_info->Sparse)
+			globus_range_list_insert(stor_info->Received, Offset, Length);
 		if (Length)
-			globus_list_insert(&stor_info->ReadyBufferList, stor_buffer);
+			stor_ready_buffer_insert(stor_info, stor_buffer);
 		else
-			globus_list_insert(&stor_info->FreeBufferList, stor_buffer);
+			stor_free_buffer_push(stor_info, stor_buffer);
 
 		/* Decrease the current connection count. */
 		stor_info->CurConnCnt--;
 
-		/* Wake the PIO thread */
-		pthread_cond_signal(&stor_info->Cond);
+		/* Wake the PIO threads */
+		pthread_cond_broadcast(&stor_info->Cond);
 	}
 	pthread_mutex_unlock(&stor_info->Mutex);
 }
 
-
-/* 1 = found, 0 = not found */
-int
-stor_find_buffer(void * Datum, void * Arg)
-{
-	if (((stor_buffer_t *)Datum)->TransferOffset == *((uint64_t *)Arg))
-		return 1;
-
-	return 0;
-}
-
 /* Called locked. */
 uint64_t
 stor_copy_out_buffers(stor_info_t * StorInfo,
@@ -260,7 +361,6 @@ stor_copy_out_buffers(stor_info_t * StorInfo,
                       uint64_t      Offset,
                       uint64_t      Length)
 {
-	globus_list_t * buf_entry      = NULL;
 	stor_buffer_t * stor_buffer    = NULL;
 	uint64_t        offset_needed  = 0;
 	uint64_t        copied_length  = 0;
@@ -271,13 +371,12 @@ stor_copy_out_buffers(stor_info_t * StorInfo,
 		offset_needed = Offset + copied_length;
 
 		/* Look for a buffer containing this offset. */
-		buf_entry = globus_list_search_pred(StorInfo->ReadyBufferList,
-		                                    stor_find_buffer,
-		                                    &offset_needed);
+		stor_buffer = stor_find_buffer(StorInfo, offset_needed);
 
-		if (buf_entry)
+		if (stor_buffer)
 		{
-			stor_buffer = globus_list_first(buf_entry);
+			/* The offset moves, so rehash the buffer below. */
+			stor_ready_buffer_remove(StorInfo, stor_buffer);
 
 			/* Set length to copy to size of our GridFTP buffer. */
 			length_to_copy = stor_buffer->BufferLength;
@@ -296,18 +395,58 @@ stor_copy_out_buffers(stor_info_t * StorInfo,
 			stor_buffer->BufferLength   -= length_to_copy;
 			copied_length               += length_to_copy;
 
-			/* If empty, move it to free. */
-			if (stor_buffer->BufferLength == 0)
-			{
-				globus_list_remove(&StorInfo->ReadyBufferList, buf_entry);
-				globus_list_insert(&StorInfo->FreeBufferList,  stor_buffer);
-			}
+			/* If empty, move it to free once the hasher is done with it. */
+			if (stor_buffer->BufferLength != 0)
+				stor_ready_buffer_insert(StorInfo, stor_buffer);
+			else if (stor_buffer->HashPending)
+				StorInfo->HashDrainCnt++;
+			else
+				stor_free_buffer_push(StorInfo, stor_buffer);
 		}
-	} while (copied_length != Length && buf_entry);
+	} while (copied_length != Length && stor_buffer);
 
 	return copied_length;
 }
 
+/*
+ * Called locked. If a ready buffer holds exactly the block PIO wants,
+ * swap it with PIO's buffer. The buffer PIO gave up is no longer in
+ * use by HPSS once it calls us back, so it joins the free list.
+ * Returns the number of bytes handed to PIO, 0 or Length.
+ */
+uint64_t
+stor_exchange_buffer(stor_info_t * StorInfo,
+                     char       ** Buffer,
+                     uint64_t      Offset,
+                     uint64_t      Length)
+{
+	stor_buffer_t * stor_buffer = NULL;
+	char          * tmp_buffer  = NULL;
+
+	stor_buffer = stor_find_buffer(StorInfo, Offset);
+	if (!stor_buffer)
+		return 0;
+
+	/*
+	 * Partially consumed or short buffers must be copied, as must any the
+	 * hasher is still reading; PIO would reuse it.
+	 */
+	if (stor_buffer->BufferOffset != 0 || stor_buffer->BufferLength != Length)
+		return 0;
+	if (stor_buffer->HashPending)
+		return 0;
+
+	tmp_buffer          = stor_buffer->Buffer;
+	stor_buffer->Buffer = *Buffer;
+	*Buffer             = tmp_buffer;
+
+	stor_ready_buffer_remove(StorInfo, stor_buffer);
+	stor_buffer->BufferLength = 0;
+	stor_free_buffer_push(StorInfo, stor_buffer);
+
+	return Length;
+}
+
 /* Called locked. */
 globus_result_t
 stor_launch_gridftp_reads(stor_info_t * StorInfo)
@@ -322,15 +461,18 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 		                                             &StorInfo->OptConnCnt);
 	if (StorInfo->ConnChkCnt >= 100) StorInfo->ConnChkCnt = 0;
 
-	// This code assumes the buffers are coming in in order.
+	/*
+	 * Buffers holding blocks PIO isn't ready for don't count against the
+	 * concurrency, only against the reorder window.
+	 */
 	while (StorInfo->CurConnCnt < StorInfo->OptConnCnt)
 	{
-		if (!globus_list_empty(StorInfo->FreeBufferList))
+		if (StorInfo->FreeBuffers)
 		{
 			/* Grab a buffer from the free list. */
-			stor_buffer = globus_list_remove(&StorInfo->FreeBufferList,
-			                                  StorInfo->FreeBufferList);
-		} else if (globus_list_size(StorInfo->AllBufferList) >= StorInfo->OptConnCnt)
+			stor_buffer = stor_free_buffer_pop(StorInfo);
+		} else if (StorInfo->AllBufferCnt >= StorInfo->OptConnCnt &&
+		           StorInfo->AllBufferCnt >= StorInfo->MaxBufferCnt)
 		{
 			break;
 		} else
@@ -342,16 +484,20 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 				result = GlobusGFSErrorMemory("stor_buffer_t");
 				break;
 			}
-			stor_buffer->Buffer = globus_malloc(StorInfo->BlockSize);
+			stor_buffer->Buffer = pool_alloc(StorInfo->Pool, StorInfo->BlockSize);
 			if (!stor_buffer->Buffer)
 			{
 				free(stor_buffer);
 				result = GlobusGFSErrorMemory("stor_buffer_t");
 				break;
 			}
-			stor_buffer->StorInfo = StorInfo;
-			stor_buffer->Valid = VALID_TAG;
-			globus_list_insert(&StorInfo->AllBufferList, stor_buffer);
+			stor_buffer->StorInfo    = StorInfo;
+			stor_buffer->Valid       = VALID_TAG;
+			stor_buffer->HashPending = 0;
+			stor_buffer->Next        = NULL;
+			stor_buffer->AllNext     = StorInfo->AllBuffers;
+			StorInfo->AllBuffers     = stor_buffer;
+			StorInfo->AllBufferCnt++;
 		}
 
 		result = globus_gridftp_server_register_read(StorInfo->Operation,
@@ -370,23 +516,56 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 	return result;
 }
 
+/*
+ * Called locked. If every buffer holds a block PIO can't use yet and no
+ * reads are outstanding, the blocks PIO wants can never arrive. A ready
+ * block may be for a participant still busy in HPSS, so this only holds
+ * once every participant waits on a block that is not here. Buffers PIO
+ * has emptied come back once the hasher is done with them, but ready
+ * buffers the hasher holds still fill the window. Without a window, data
+ * arrives in order.
+ */
+static globus_result_t
+stor_check_reorder_window(stor_info_t * StorInfo)
+{
+	int             blocked = 0;
+	stor_waiter_t * waiter  = NULL;
+
+	GlobusGFSName(stor_check_reorder_window);
+
+	if (!StorInfo->Config->StorReorderWindow)
+		return GLOBUS_SUCCESS;
+
+	if (StorInfo->CurConnCnt != 0 || StorInfo->FreeBuffers || StorInfo->ReadyBufferCnt == 0 ||
+	    StorInfo->HashDrainCnt != 0)
+		return GLOBUS_SUCCESS;
+
+	for (waiter = StorInfo->Waiters; waiter; waiter = waiter->Next)
+	{
+		if (!stor_find_buffer(StorInfo, waiter->Offset))
+			blocked++;
+	}
+
+	if (blocked < StorInfo->ParticipantCnt)
+		return GLOBUS_SUCCESS;
+
+	return GlobusGFSErrorGeneric("Out of order data exceeds the reorder window. "
+	                             "Increase StorReorderWindow or use fewer parallel streams.");
+}
+
 /* Called locked. */
-//globus_result_t
-//stor_check_for_parallel_conns(stor_info_t * StorInfo, uint64_t Offset)
-//{
-//	GlobusGFSName(stor_check_for_parallel_conns);
-//	if (globus_list_size(StorInfo->ReadyBufferList) > 0)
-//	{
-//		if (globus_list_search_pred(StorInfo->ReadyBufferList, stor_find_buffer, &Offset) == NULL)
-//		{
-//			return GlobusGFSErrorGeneric("Out of order buffer offsets detected. Please disable parallel data channels.");
-//		}
-//	}
-//	return GLOBUS_SUCCESS;
-//}
+static void
+stor_waiter_remove(stor_info_t * StorInfo, stor_waiter_t * Waiter)
+{
+	stor_waiter_t ** entry = &StorInfo->Waiters;
+
+	while (*entry != Waiter)
+		entry = &(*entry)->Next;
+	*entry = Waiter->Next;
+}
 
 int
-stor_pio_callout(char     * Buffer,
+stor_pio_callout(char    ** Buffer,
                  uint32_t * Length,
                  uint64_t   Offset,
                  void     * CallbackArg)
@@ -394,8 +573,11 @@ stor_pio_callout(char     * Buffer,
 	int             rc            = 0;
 	uint64_t        offset_needed = 0;
 	uint64_t        copied_length = 0;
+	uint64_t        moved_length  = 0;
 	stor_info_t   * stor_info     = CallbackArg;
 	globus_result_t result        = GLOBUS_SUCCESS;
+	uint64_t        wait_start    = telemetry_now();
+	stor_waiter_t   waiter;
 
 	GlobusGFSName(stor_pio_callout);
 
@@ -405,10 +587,14 @@ stor_pio_callout(char     * Buffer,
 		{
 			offset_needed = Offset + copied_length;
 
-			copied_length += stor_copy_out_buffers(stor_info,
-			                                       Buffer + copied_length,
-			                                       offset_needed,
-			                                       *Length - copied_length);
+			if (stor_info->ZeroCopy && copied_length == 0)
+				copied_length = stor_exchange_buffer(stor_info, Buffer, Offset, *Length);
+
+			if (copied_length != *Length)
+				copied_length += stor_copy_out_buffers(stor_info,
+				                                       *Buffer + copied_length,
+				                                       offset_needed,
+				                                       *Length - copied_length);
 
 			if (stor_info->Eof)
 			{
@@ -417,13 +603,20 @@ stor_pio_callout(char     * Buffer,
 				break;
 			}
 
-//			result = stor_check_for_parallel_conns(stor_info, Offset + copied_length);
-
-			if (!result)
-				result = stor_launch_gridftp_reads(stor_info);
+			result = stor_launch_gridftp_reads(stor_info);
 
 			if (!result && copied_length != *Length)
-				pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+			{
+				waiter.Offset      = Offset + copied_length;
+				waiter.Next        = stor_info->Waiters;
+				stor_info->Waiters = &waiter;
+
+				result = stor_check_reorder_window(stor_info);
+				if (!result)
+					pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+
+				stor_waiter_remove(stor_info, &waiter);
+			}
 		}
 
 		if (copied_length)
@@ -433,15 +626,23 @@ stor_pio_callout(char     * Buffer,
 			stor_info->Result = result;
 		if (stor_info->Result)
 			copied_length = -1;
+		else
+			moved_length = copied_length;
 
 		if (result)
 		{
 			if (!stor_info->Result) stor_info->Result = result;
 			rc = PIO_END_TRANSFER; /* Signal to shutdown. */
+
+			/* Other participants may be waiting on data. */
+			pthread_cond_broadcast(&stor_info->Cond);
 		}
 	}
 	pthread_mutex_unlock(&stor_info->Mutex);
 
+	telemetry_record(&stor_info->Telemetry, TELEMETRY_WAIT, wait_start);
+	telemetry_add_bytes(&stor_info->Telemetry, moved_length);
+
 	return rc;
 }
 
@@ -454,7 +655,7 @@ stor_wait_for_gridftp(stor_info_t * StorInfo)
 		{
 			if (StorInfo->Result) break;
 
-			if (globus_list_size(StorInfo->AllBufferList) == globus_list_size(StorInfo->FreeBufferList))
+			if (StorInfo->AllBufferCnt == StorInfo->FreeBufferCnt)
 				break;
 
 			pthread_cond_wait(&StorInfo->Cond, &StorInfo->Mutex);
@@ -489,22 +690,130 @@ assert(*Length <= stor_info->RangeLength);
 	}
 }
 
+/* Called locked. */
 static int
-release_buffer(void * Datum, void * Arg)
+stor_can_read_more(stor_info_t * StorInfo)
+{
+	if (StorInfo->Eof)
+		return 0;
+	if (StorInfo->FreeBuffers)
+		return 1;
+	return (StorInfo->AllBufferCnt < StorInfo->OptConnCnt ||
+	        StorInfo->AllBufferCnt < StorInfo->MaxBufferCnt);
+}
+
+/*
+ * Sparse mode. Picks the largest received extent for PIO to write next.
+ * Small extents wait for their neighbors to arrive unless no more data
+ * can be read until buffers are freed. Sets Eot once all the data has
+ * arrived and been handed to PIO.
+ */
+static void
+stor_next_sparse_range(stor_info_t  * StorInfo,
+                       globus_off_t * Offset,
+                       globus_off_t * Length,
+                       int          * Eot)
+{
+	int             i           = 0;
+	globus_off_t    offset      = 0;
+	globus_off_t    length      = 0;
+	globus_off_t    best_offset = 0;
+	globus_off_t    best_length = 0;
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	pthread_mutex_lock(&StorInfo->Mutex);
+	{
+		while (!StorInfo->Result)
+		{
+			best_length = 0;
+			for (i = 0; i < globus_range_list_size(StorInfo->Received); i++)
+			{
+				globus_range_list_at(StorInfo->Received, i, &offset, &length);
+				if (length > best_length)
+				{
+					best_offset = offset;
+					best_length = length;
+				}
+			}
+
+			if (best_length >= StorInfo->BlockSize * StorInfo->OptConnCnt)
+				break;
+			if (best_length && !stor_can_read_more(StorInfo))
+				break;
+			if (!best_length && StorInfo->Eof && StorInfo->CurConnCnt == 0)
+				break;
+
+			result = stor_launch_gridftp_reads(StorInfo);
+			if (result)
+			{
+				StorInfo->Result = result;
+				break;
+			}
+
+			pthread_cond_wait(&StorInfo->Cond, &StorInfo->Mutex);
+		}
+
+		*Eot = (StorInfo->Result || best_length == 0);
+		if (!*Eot)
+		{
+			globus_range_list_remove(StorInfo->Received, best_offset, best_length);
+			*Offset = best_offset;
+			*Length = best_length;
+		}
+		StorInfo->ScheduledLength = *Eot ? 0 : best_length;
+	}
+	pthread_mutex_unlock(&StorInfo->Mutex);
+}
+
+void
+stor_sparse_range_complete_callback(globus_off_t * Offset,
+                                    globus_off_t * Length,
+                                    int          * Eot,
+                                    void         * UserArg)
+{
+	stor_info_t * stor_info = UserArg;
+
+	/* Each extent is its own restart marker. */
+	if (*Length)
+		markers_update_restart_markers(stor_info->Operation, *Offset, *Length);
+
+	/* Anything PIO didn't get to is still buffered; try it again. */
+	pthread_mutex_lock(&stor_info->Mutex);
+	{
+		if (*Length < stor_info->ScheduledLength)
+			globus_range_list_insert(stor_info->Received,
+			                         *Offset + *Length,
+			                         stor_info->ScheduledLength - *Length);
+	}
+	pthread_mutex_unlock(&stor_info->Mutex);
+
+	stor_next_sparse_range(stor_info, Offset, Length, Eot);
+}
+
+static void
+release_buffers(stor_info_t * StorInfo)
 {
-	((stor_buffer_t *)Datum)->Valid = INVALID_TAG;
-	free(((stor_buffer_t *)Datum)->Buffer);
+	stor_buffer_t * stor_buffer = NULL;
 
-	return 0;
+	while ((stor_buffer = StorInfo->AllBuffers))
+	{
+		StorInfo->AllBuffers = stor_buffer->AllNext;
+		stor_buffer->Valid   = INVALID_TAG;
+		pool_free(StorInfo->Pool, stor_buffer->Buffer, StorInfo->BlockSize);
+		free(stor_buffer);
+	}
 }
 
 void
 stor_transfer_complete_callback(globus_result_t Result,
                                 void          * UserArg)
 {
-	globus_result_t result    = Result;
-	stor_info_t   * stor_info = UserArg;
-	int             rc        = 0;
+	globus_result_t result      = Result;
+	globus_result_t hash_result = GLOBUS_SUCCESS;
+	stor_info_t   * stor_info   = UserArg;
+	int             rc          = 0;
+	char          * cksm_string = NULL;
+	uint64_t        start       = telemetry_now();
 
 	GlobusGFSName(stor_transfer_complete_callback);
 
@@ -516,24 +825,194 @@ stor_transfer_complete_callback(globus_result_t Result,
 	{
 		stor_wait_for_gridftp(stor_info);
 		result = stor_info->Result;
+		telemetry_record(&stor_info->Telemetry, TELEMETRY_WAIT, start);
 	}
-	
+
+	start = telemetry_now();
 	rc = hpss_Close(stor_info->FileFD);
 	if (rc && !result)
 		result = GlobusGFSErrorSystemError("hpss_Close", -rc);
+	telemetry_record(&stor_info->Telemetry, TELEMETRY_CLOSE, start);
+
+	/* Drop anything cached while the file was being written. */
+	attrcache_invalidate(stor_info->Config->AttrCache, stor_info->TransferInfo->pathname);
 
+	/*
+	 * Record the checksum before finishing the transfer so that a CKSM that
+	 * follows immediately finds it.
+	 */
+	if (stor_info->Checksum)
+	{
+		/* Small files are hashed inline, without a hasher. */
+		if (stor_info->Hasher)
+			hash_result = hasher_finish(stor_info->Hasher, result != GLOBUS_SUCCESS, NULL, NULL);
+		if (!result && !hash_result)
+			hash_result = checksum_final(stor_info->Checksum, &cksm_string);
+		if (!result && !hash_result)
+			hash_result = cksm_set_checksum(stor_info->TransferInfo->pathname,
+			                                stor_info->Config,
+			                                checksum_name(stor_info->Checksum),
+			                                cksm_string);
+		if (!result && hash_result)
+			globus_gfs_log_message(GLOBUS_GFS_LOG_WARN,
+			                       "HPSS DSI: inline checksum of %s was not stored\n",
+			                       stor_info->TransferInfo->pathname);
+		if (cksm_string)
+			free(cksm_string);
+	}
+	checksum_destroy(stor_info->Checksum);
+
+	telemetry_finish(&stor_info->Telemetry, stor_info->TransferInfo->pathname, result);
 	globus_gridftp_server_finished_transfer(stor_info->Operation, result);
 
+	if (stor_info->Received)
+		globus_range_list_destroy(stor_info->Received);
+	if (stor_info->SmallBuffer)
+		pool_free(stor_info->Pool, stor_info->SmallBuffer, stor_info->BlockSize);
+
 	pthread_mutex_destroy(&stor_info->Mutex);
 	pthread_cond_destroy(&stor_info->Cond);
-	globus_list_free(stor_info->FreeBufferList);
-	globus_list_free(stor_info->ReadyBufferList);
-
-	globus_list_search_pred(stor_info->AllBufferList, release_buffer, NULL);
-	globus_list_destroy_all(stor_info->AllBufferList, free);
+	release_buffers(stor_info);
 	free(stor_info);
 }
 
+/*
+ * Small files skip PIO. Each block is written with hpss_Write() from the
+ * data channel's callback, then the next read is registered. There is one
+ * read outstanding at a time.
+ */
+static void
+stor_small_file_callout(globus_gfs_operation_t Operation,
+                        globus_result_t        Result,
+                        globus_byte_t        * Buffer,
+                        globus_size_t          Length,
+                        globus_off_t           Offset,
+                        globus_bool_t          Eof,
+                        void                 * UserArg)
+{
+	ssize_t         bytes     = 0;
+	globus_size_t   written   = 0;
+	stor_info_t   * stor_info = UserArg;
+	globus_result_t result    = Result;
+	uint64_t        start     = telemetry_now();
+
+	GlobusGFSName(stor_small_file_callout);
+
+	telemetry_record(&stor_info->Telemetry, TELEMETRY_WAIT, stor_info->SmallReadStart);
+
+	if (!result && Length)
+	{
+		bytes = hpss_Lseek(stor_info->FileFD, Offset, SEEK_SET);
+		if (bytes < 0)
+			result = GlobusGFSErrorSystemError("hpss_Lseek", -bytes);
+	}
+
+	while (!result && written < Length)
+	{
+		bytes = hpss_Write(stor_info->FileFD, Buffer + written, Length - written);
+		if (bytes < 0)
+			result = GlobusGFSErrorSystemError("hpss_Write", -bytes);
+		else
+			written += bytes;
+	}
+
+	if (!result && Length)
+	{
+		telemetry_record(&stor_info->Telemetry, TELEMETRY_HPSS, start);
+		telemetry_add_bytes(&stor_info->Telemetry, Length);
+
+		markers_update_perf_markers(Operation, Offset, Length);
+		markers_update_restart_markers(Operation, Offset, Length);
+
+		/* Hash in order or not at all. */
+		if (stor_info->Checksum && Offset != stor_info->ChecksumOffset)
+		{
+			checksum_destroy(stor_info->Checksum);
+			stor_info->Checksum = NULL;
+		}
+		if (stor_info->Checksum)
+		{
+			checksum_update(stor_info->Checksum, (char *)Buffer, Length);
+			stor_info->ChecksumOffset += Length;
+		}
+	}
+
+	if (!result && !Eof)
+	{
+		stor_info->SmallReadStart = telemetry_now();
+		result = globus_gridftp_server_register_read(Operation,
+		                                             Buffer,
+		                                             stor_info->BlockSize,
+		                                             stor_small_file_callout,
+		                                             stor_info);
+		if (!result)
+			return;
+	}
+
+	stor_transfer_complete_callback(result, stor_info);
+}
+
+/*
+ * Sparse mode can't start PIO until the first extent arrives. Wait for it
+ * here rather than on the server's thread.
+ */
+static void *
+stor_sparse_thread(void * Arg)
+{
+	int             eot       = 0;
+	globus_off_t    offset    = 0;
+	globus_off_t    length    = 0;
+	stor_info_t   * stor_info = Arg;
+	globus_result_t result    = GLOBUS_SUCCESS;
+
+	GlobusGFSName(stor_sparse_thread);
+
+	stor_next_sparse_range(stor_info, &offset, &length, &eot);
+	if (eot)
+	{
+		stor_transfer_complete_callback(GLOBUS_SUCCESS, stor_info);
+		return NULL;
+	}
+
+	result = pio_start(HPSS_PIO_WRITE,
+	                   stor_info->FileFD,
+	                   stor_info->FileStripeWidth,
+	                   stor_info->Config->ClientStripeWidth,
+	                   stor_info->BlockSize,
+	                   stor_info->Pool,
+	                   &stor_info->Telemetry,
+	                   offset,
+	                   length,
+	                   stor_pio_callout,
+	                   stor_sparse_range_complete_callback,
+	                   stor_transfer_complete_callback,
+	                   stor_info);
+	if (result)
+		stor_transfer_complete_callback(result, stor_info);
+
+	return NULL;
+}
+
+/*
+ * Fails a sparse transfer that could not start PIO. Registered reads hold
+ * stor_info, so wait for them to land before tearing it down.
+ */
+static void
+stor_sparse_abort(stor_info_t * StorInfo, globus_result_t Result)
+{
+	pthread_mutex_lock(&StorInfo->Mutex);
+	{
+		if (!StorInfo->Result)
+			StorInfo->Result = Result;
+
+		while (StorInfo->CurConnCnt > 0)
+			pthread_cond_wait(&StorInfo->Cond, &StorInfo->Mutex);
+	}
+	pthread_mutex_unlock(&StorInfo->Mutex);
+
+	stor_transfer_complete_callback(Result, StorInfo);
+}
+
 void
 stor(globus_gfs_operation_t       Operation,
      globus_gfs_transfer_info_t * TransferInfo,
@@ -541,8 +1020,9 @@ stor(globus_gfs_operation_t       Operation,
 {
 	stor_info_t   * stor_info         = NULL;
 	globus_result_t result            = GLOBUS_SUCCESS;
-	int             file_stripe_width = 0;
 	globus_off_t    offset            = 0;
+	globus_off_t    optimum_access_size = 0;
+	uint64_t        start             = 0;
 
 	GlobusGFSName(stor);
 
@@ -558,31 +1038,128 @@ stor(globus_gfs_operation_t       Operation,
 	memset(stor_info, 0, sizeof(stor_info_t));
 	stor_info->Operation    = Operation;
 	stor_info->TransferInfo = TransferInfo;
+	stor_info->Config       = Config;
 	stor_info->FileFD       = -1;
+	stor_info->ZeroCopy     = Config->StorZeroCopy;
+	stor_info->Pool         = Config->BufferPool;
 	pthread_mutex_init(&stor_info->Mutex, NULL);
 	pthread_cond_init(&stor_info->Cond, NULL);
+	telemetry_init(&stor_info->Telemetry, "STOR");
 
 	globus_gridftp_server_get_block_size(Operation, &stor_info->BlockSize);
 
+	attrcache_invalidate(Config->AttrCache, TransferInfo->pathname);
+
 	result = cksm_clear_checksum(TransferInfo->pathname, Config);
 	if (result) goto cleanup;
 
 	/*
 	 * Open the file.
 	 */
+	start = telemetry_now();
 	result = stor_open_for_writing(TransferInfo->pathname,
 	                               TransferInfo->alloc_size,
 	                               TransferInfo->truncate,
 	                               &stor_info->FileFD,
-	                               &file_stripe_width);
+	                               &stor_info->FileStripeWidth,
+	                               &optimum_access_size);
 	if (result) goto cleanup;
+	telemetry_record(&stor_info->Telemetry, TELEMETRY_OPEN, start);
+
+	/* Without ALLO we don't know how big the file will be. */
+	stor_info->BlockSize = blocksize_select(Config,
+	                                        TransferInfo->pathname,
+	                                        stor_info->BlockSize,
+	                                        TransferInfo->alloc_size ? TransferInfo->alloc_size : -1,
+	                                        stor_info->FileStripeWidth,
+	                                        optimum_access_size);
+	stor_info->MaxBufferCnt = Config->StorReorderWindow / stor_info->BlockSize;
+
+	/* As pio_start() will run them. */
+	stor_info->ParticipantCnt = Config->ClientStripeWidth;
+	if (stor_info->ParticipantCnt > stor_info->FileStripeWidth)
+		stor_info->ParticipantCnt = stor_info->FileStripeWidth;
+	if (stor_info->ParticipantCnt < 1)
+		stor_info->ParticipantCnt = 1;
 
 	globus_gridftp_server_begin_transfer(Operation, 0, NULL);
 
+	/*
+	 * Only a whole file, written from the start, gives a checksum of the
+	 * file. The UDA is where it is kept, so it needs UDAChecksumSupport.
+	 * Sparse writes reach PIO in no useful order, so they are not hashed.
+	 */
+	if (Config->InlineChecksum && Config->UDAChecksumSupport && !Config->StorSparseWrites &&
+	    TransferInfo->truncate && cksm_is_whole_file(TransferInfo))
+	{
+		result = checksum_init(&stor_info->Checksum, Config->InlineChecksum);
+		if (result) goto cleanup;
+	}
+
+	/*
+	 * For small files, setting up PIO costs more than moving the data.
+	 * stor_transfer_complete_callback() finishes from here on.
+	 */
+	if (Config->SmallFileThreshold &&
+	    TransferInfo->alloc_size > 0 &&
+	    TransferInfo->alloc_size <= Config->SmallFileThreshold)
+	{
+		stor_info->SmallBuffer = pool_alloc(stor_info->Pool, stor_info->BlockSize);
+		if (!stor_info->SmallBuffer)
+		{
+			result = GlobusGFSErrorMemory("small file buffer");
+			goto cleanup;
+		}
+
+		stor_info->SmallReadStart = telemetry_now();
+		result = globus_gridftp_server_register_read(Operation,
+		                                            (globus_byte_t *)stor_info->SmallBuffer,
+		                                             stor_info->BlockSize,
+		                                             stor_small_file_callout,
+		                                             stor_info);
+		if (result) goto cleanup;
+		return;
+	}
+
+	if (Config->StorSparseWrites)
+	{
+		stor_info->Sparse = 1;
+		if (globus_range_list_init(&stor_info->Received))
+		{
+			result = GlobusGFSErrorMemory("globus_range_list_t");
+			goto cleanup;
+		}
+
+		/* stor_transfer_complete_callback() finishes from here on. */
+		pthread_mutex_lock(&stor_info->Mutex);
+		{
+			result = stor_launch_gridftp_reads(stor_info);
+		}
+		pthread_mutex_unlock(&stor_info->Mutex);
+
+		if (!result)
+			result = pio_launch_detached(stor_sparse_thread, stor_info);
+		if (result)
+			stor_sparse_abort(stor_info, result);
+		return;
+	}
+
 	globus_gridftp_server_get_write_range(Operation, &offset, &stor_info->RangeLength);
 	if (stor_info->RangeLength == -1)
 		stor_info->RangeLength = TransferInfo->alloc_size;
 
+	if (stor_info->Checksum)
+	{
+		result = hasher_start(&stor_info->Hasher,
+		                      checksum_update,
+		                      stor_info->Checksum,
+		                      0,
+		                      stor_info->BlockSize,
+		                      CKSM_HASH_QUEUE_DEPTH,
+		                      stor_info->Pool);
+		if (result) goto cleanup;
+	}
+
 	/* when alloc_size is 0, pio_start/stor_transfer_complete_callback will
 	 * call globus_gridftp_server_finished_transfer with success, but
 	 * without reading EOF from gridftp.  launch gridftp read now to
@@ -604,8 +1181,11 @@ stor(globus_gfs_operation_t       Operation,
 	 */
 	result = pio_start(HPSS_PIO_WRITE,
 	                   stor_info->FileFD,
-	                   file_stripe_width,
+	                   stor_info->FileStripeWidth,
+	                   Config->ClientStripeWidth,
 	                   stor_info->BlockSize,
+	                   stor_info->Pool,
+	                   &stor_info->Telemetry,
 	                   offset,
 	                   stor_info->RangeLength,
 	                   stor_pio_callout,
@@ -619,8 +1199,16 @@ cleanup:
 		globus_gridftp_server_finished_transfer(Operation, result);
 		if (stor_info)
 		{
+			telemetry_finish(&stor_info->Telemetry, TransferInfo->pathname, result);
 			if (stor_info->FileFD != -1)
 				hpss_Close(stor_info->FileFD);
+			if (stor_info->Hasher)
+				hasher_finish(stor_info->Hasher, 1, NULL, NULL);
+			checksum_destroy(stor_info->Checksum);
+			if (stor_info->SmallBuffer)
+				pool_free(stor_info->Pool, stor_info->SmallBuffer, stor_info->BlockSize);
+			if (stor_info->Received)
+				globus_range_list_destroy(stor_info->Received);
 			pthread_mutex_destroy(&stor_info->Mutex);
 			pthread_cond_destroy(&stor_info->Cond);
 			free(stor_info);
@@ -50,21 +50,23 @@
  * Globus includes
  */
 #include <globus_gridftp_server.h>
-#include <globus_list.h>
 
 /*
  * Local includes
  */
 #include "config.h"
 #include "pio.h"
+#include "hasher.h"
+#include "checksum.h"
 
 /*
  * Because of the sequential, ascending nature of offsets with PIO,
- * we do not need a range list.
+ * we do not need a range list. Blocks from parallel streams may arrive
+ * out of order; they wait in the ready table until PIO asks for them.
  */
 struct stor_info;
 
-typedef struct {
+typedef struct stor_buffer {
 	char             * Buffer;
 	globus_off_t       BufferOffset;   // Moves as buffer is consumed
 	globus_off_t       TransferOffset; // Moves as BufferOffset moves
@@ -73,16 +75,36 @@ typedef struct {
 #define VALID_TAG   0xDEADBEEF
 #define INVALID_TAG 0x00000000
 	int                Valid; // Debug Entry
+	int                HashPending;    // Hasher still reading Buffer
+
+	struct stor_buffer * Next;    // Free list or ready table chain
+	struct stor_buffer * AllNext; // All buffers list
 } stor_buffer_t;
 
+/*
+ * Ready buffers are hashed by the block index of their TransferOffset.
+ * Since GridFTP fills buffers in BlockSize units, in-order blocks land
+ * in consecutive buckets and lookups are constant time.
+ */
+#define STOR_READY_TABLE_SIZE 256
+
+/* A participant blocked in stor_pio_callout() on Offset. On its stack. */
+typedef struct stor_waiter {
+	globus_off_t         Offset;
+	struct stor_waiter * Next;
+} stor_waiter_t;
+
 typedef struct stor_info {
 	globus_gfs_operation_t       Operation;
 	globus_gfs_transfer_info_t * TransferInfo;
+	config_t                   * Config;
 
 	int FileFD;
+	int FileStripeWidth;
 
 	globus_result_t Result;
 	globus_size_t   BlockSize;
+	pool_t        * Pool;
 
 	pthread_mutex_t Mutex;
 	pthread_cond_t  Cond;
@@ -94,9 +116,55 @@ typedef struct stor_info {
 	int ConnChkCnt;
 	int CurConnCnt;
 
-	globus_list_t * AllBufferList;
-	globus_list_t * ReadyBufferList;
-	globus_list_t * FreeBufferList;
+	/*
+	 * Most buffers we may hold while waiting on out of order blocks, from
+	 * StorReorderWindow. Never less than OptConnCnt.
+	 */
+	int MaxBufferCnt;
+
+	/*
+	 * PIO participants, and those waiting on data. The window has
+	 * overflowed only once all of them wait on blocks that are not here.
+	 */
+	int             ParticipantCnt;
+	stor_waiter_t * Waiters;
+
+	/* Exchange aligned buffers with PIO instead of copying them. */
+	int ZeroCopy;
+
+	stor_buffer_t * AllBuffers;
+	stor_buffer_t * FreeBuffers;
+	stor_buffer_t * ReadyBuffers[STOR_READY_TABLE_SIZE];
+
+	int AllBufferCnt;
+	int FreeBufferCnt;
+	int ReadyBufferCnt;
+
+	/*
+	 * Sparse mode hands PIO whatever extents have arrived, largest first,
+	 * instead of walking the file in order. Received holds data that has
+	 * arrived but not yet been given to PIO; ScheduledLength is the extent
+	 * PIO is writing now.
+	 */
+	int                 Sparse;
+	globus_range_list_t Received;
+	globus_off_t        ScheduledLength;
+
+	/* Small files skip PIO and are written straight from this buffer. */
+	char     * SmallBuffer;
+	uint64_t   SmallReadStart;
+
+	/*
+	 * Inline checksum of the incoming data, NULL if not computed. Small
+	 * files hash on the callback thread; ChecksumOffset is the next
+	 * offset expected.
+	 */
+	checksum_t   * Checksum;
+	hasher_t     * Hasher;
+	globus_off_t   ChecksumOffset;
+	int            HashDrainCnt; // Buffers PIO is done with, still hashing
+
+	telemetry_t Telemetry;
 
 } stor_info_t;
 
@@ -0,0 +1,187 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Local includes
+ */
+#include "telemetry.h"
+
+static const char * _gPhaseNames[TELEMETRY_PHASES] = {
+	"open",
+	"pio_start",
+	"hpss",
+	"wait",
+	"close",
+};
+
+/* Monotonic time in microseconds. */
+uint64_t
+telemetry_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void
+telemetry_init(telemetry_t * Telemetry, const char * Op)
+{
+	memset(Telemetry, 0, sizeof(telemetry_t));
+	pthread_mutex_init(&Telemetry->Lock, NULL);
+	Telemetry->Op    = Op;
+	Telemetry->Start = telemetry_now();
+}
+
+void
+telemetry_record(telemetry_t * Telemetry, telemetry_phase_t Phase, uint64_t Start)
+{
+	uint64_t            elapsed = telemetry_now() - Start;
+	uint64_t            limit   = 100;
+	int                 bucket  = 0;
+	telemetry_stats_t * stats   = &Telemetry->Phases[Phase];
+
+	while (bucket < TELEMETRY_HIST_BUCKETS - 1 && elapsed >= limit)
+	{
+		bucket++;
+		limit *= 10;
+	}
+
+	pthread_mutex_lock(&Telemetry->Lock);
+	{
+		stats->Count++;
+		stats->Total += elapsed;
+		if (elapsed > stats->Max)
+			stats->Max = elapsed;
+		stats->Hist[bucket]++;
+	}
+	pthread_mutex_unlock(&Telemetry->Lock);
+}
+
+void
+telemetry_add_bytes(telemetry_t * Telemetry, uint64_t Bytes)
+{
+	pthread_mutex_lock(&Telemetry->Lock);
+	{
+		Telemetry->Bytes += Bytes;
+	}
+	pthread_mutex_unlock(&Telemetry->Lock);
+}
+
+void
+telemetry_set_hash(telemetry_t * Telemetry, uint64_t HashTime, uint64_t StallTime)
+{
+	pthread_mutex_lock(&Telemetry->Lock);
+	{
+		Telemetry->HashTime  = HashTime;
+		Telemetry->StallTime = StallTime;
+	}
+	pthread_mutex_unlock(&Telemetry->Lock);
+}
+
+void
+telemetry_finish(telemetry_t * Telemetry, const char * Pathname, globus_result_t Result)
+{
+	char                line[1024];
+	int                 length  = 0;
+	int                 i       = 0;
+	int                 j       = 0;
+	uint64_t            elapsed = telemetry_now() - Telemetry->Start;
+	telemetry_stats_t * stats   = NULL;
+
+	/* Only this thread is left; no need to lock. */
+	length = snprintf(line, sizeof(line),
+	                  "op=%s result=%s bytes=%llu elapsed_us=%llu MBps=%.2f",
+	                  Telemetry->Op,
+	                  Result ? "error" : "ok",
+	                  (unsigned long long)Telemetry->Bytes,
+	                  (unsigned long long)elapsed,
+	                  elapsed ? (double)Telemetry->Bytes / elapsed : 0.0);
+
+	if (Telemetry->HashTime || Telemetry->StallTime)
+		length += snprintf(line + length, sizeof(line) - length,
+		                   " hash_us=%llu hash_stall_us=%llu",
+		                   (unsigned long long)Telemetry->HashTime,
+		                   (unsigned long long)Telemetry->StallTime);
+
+	for (i = 0; i < TELEMETRY_PHASES && length < sizeof(line); i++)
+	{
+		stats = &Telemetry->Phases[i];
+		if (stats->Count == 0)
+			continue;
+
+		if (stats->Count == 1)
+		{
+			length += snprintf(line + length, sizeof(line) - length,
+			                   " %s_us=%llu",
+			                   _gPhaseNames[i],
+			                   (unsigned long long)stats->Total);
+			continue;
+		}
+
+		length += snprintf(line + length, sizeof(line) - length,
+		                   " %s_n=%llu %s_us=%llu %s_max_us=%llu %s_hist=",
+		                   _gPhaseNames[i], (unsigned long long)stats->Count,
+		                   _gPhaseNames[i], (unsigned long long)stats->Total,
+		                   _gPhaseNames[i], (unsigned long long)stats->Max,
+		                   _gPhaseNames[i]);
+
+		for (j = 0; j < TELEMETRY_HIST_BUCKETS && length < sizeof(line); j++)
+		{
+			length += snprintf(line + length, sizeof(line) - length,
+			                   j ? "/%llu" : "%llu",
+			                   (unsigned long long)stats->Hist[j]);
+		}
+	}
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "HPSS DSI telemetry: %s path=%s\n",
+	                       line,
+	                       Pathname);
+
+	pthread_mutex_destroy(&Telemetry->Lock);
+}
@@ -0,0 +1,113 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_TELEMETRY_H
+#define HPSS_DSI_TELEMETRY_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Per transfer timings. RETR, STOR and CKSM time each phase with
+ * telemetry_now() and record it here; one summary line is logged when the
+ * transfer finishes. Block phases are recorded once per PIO block so their
+ * histograms show whether HPSS or the other end of the transfer is slow.
+ */
+
+typedef enum {
+	TELEMETRY_OPEN,      // hpss_Open()
+	TELEMETRY_PIO_START, // hpss_PIOStart() through the group imports
+	TELEMETRY_HPSS,      // Per block, HPSS moving the block
+	TELEMETRY_WAIT,      // Per block, waiting on the data channel or hasher
+	TELEMETRY_CLOSE,     // hpss_Close()
+	TELEMETRY_PHASES
+} telemetry_phase_t;
+
+/* Powers of ten from 100us: <100us, <1ms, ... <10s, and the rest. */
+#define TELEMETRY_HIST_BUCKETS 7
+
+typedef struct {
+	uint64_t Count;
+	uint64_t Total; // Microseconds
+	uint64_t Max;
+	uint64_t Hist[TELEMETRY_HIST_BUCKETS];
+} telemetry_stats_t;
+
+typedef struct {
+	pthread_mutex_t   Lock;
+	const char      * Op;
+	uint64_t          Start;
+	uint64_t          Bytes;
+	uint64_t          HashTime;  // From hasher_finish(), if there was a hasher
+	uint64_t          StallTime;
+	telemetry_stats_t Phases[TELEMETRY_PHASES];
+} telemetry_t;
+
+/* Monotonic time in microseconds. */
+uint64_t
+telemetry_now();
+
+void
+telemetry_init(telemetry_t * Telemetry, const char * Op);
+
+/* Records the time since Start, a telemetry_now() timestamp. */
+void
+telemetry_record(telemetry_t * Telemetry, telemetry_phase_t Phase, uint64_t Start);
+
+void
+telemetry_add_bytes(telemetry_t * Telemetry, uint64_t Bytes);
+
+/* Records the hasher's busy time and the time callers stalled on it. */
+void
+telemetry_set_hash(telemetry_t * Telemetry, uint64_t HashTime, uint64_t StallTime);
+
+/* Logs the summary line. Telemetry can not be used afterwards. */
+void
+telemetry_finish(telemetry_t * Telemetry, const char * Pathname, globus_result_t Result);
+
+#endif /* HPSS_DSI_TELEMETRY_H */
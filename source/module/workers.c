@@ -0,0 +1,306 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "workers.h"
+
+static struct {
+	pthread_mutex_t   Lock;
+	pthread_cond_t    Cond;
+	int               MaxThreads;
+	int               ThreadCnt;  // Created
+	int               BusyCnt;    // Running a task
+	int               PendingCnt; // Tasks in queued groups
+
+	/* Tasks of started groups, each waiting for a free worker. */
+	workers_task_t  * Ready;
+	workers_task_t  * ReadyTail;
+	int               ReadyCnt;
+
+	workers_group_t * Queue;
+	workers_group_t * QueueTail;
+} _workers = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+};
+
+/* Called locked. Starts queued groups, in order, while they fit. */
+static void
+workers_dispatch()
+{
+	workers_group_t * group = NULL;
+
+	while ((group = _workers.Queue))
+	{
+		if (_workers.ThreadCnt - _workers.BusyCnt - _workers.ReadyCnt < group->TaskCnt)
+			break;
+
+		_workers.Queue = group->Next;
+		if (!_workers.Queue)
+			_workers.QueueTail = NULL;
+
+		if (_workers.ReadyTail)
+			_workers.ReadyTail->Next = group->Tasks;
+		else
+			_workers.Ready = group->Tasks;
+		_workers.ReadyTail = group->TasksTail;
+
+		_workers.ReadyCnt   += group->TaskCnt;
+		_workers.PendingCnt -= group->TaskCnt;
+		free(group);
+
+		pthread_cond_broadcast(&_workers.Cond);
+	}
+}
+
+static void *
+workers_thread(void * Arg)
+{
+	workers_task_t * task = NULL;
+
+	pthread_mutex_lock(&_workers.Lock);
+	while (1)
+	{
+		while (!_workers.Ready)
+		{
+			pthread_cond_wait(&_workers.Cond, &_workers.Lock);
+		}
+
+		task = _workers.Ready;
+		_workers.Ready = task->Next;
+		if (!_workers.Ready)
+			_workers.ReadyTail = NULL;
+		_workers.ReadyCnt--;
+		_workers.BusyCnt++;
+
+		pthread_mutex_unlock(&_workers.Lock);
+		{
+			task->Func(task->Arg);
+			free(task);
+		}
+		pthread_mutex_lock(&_workers.Lock);
+
+		_workers.BusyCnt--;
+		workers_dispatch();
+	}
+	pthread_mutex_unlock(&_workers.Lock);
+
+	return NULL;
+}
+
+/* Called locked. */
+static int
+workers_create_thread()
+{
+	int            rc = 0;
+	pthread_t      thread;
+	pthread_attr_t attr;
+
+	rc = pthread_attr_init(&attr);
+	if (rc)
+		return rc;
+
+	rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (!rc)
+		rc = pthread_create(&thread, &attr, workers_thread, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (!rc)
+		_workers.ThreadCnt++;
+	return rc;
+}
+
+/* Called locked. Creates threads for work that is waiting, up to the limit. */
+static int
+workers_grow(int NewTaskCnt)
+{
+	int rc     = 0;
+	int wanted = _workers.BusyCnt + _workers.ReadyCnt + _workers.PendingCnt + NewTaskCnt;
+
+	/* A group larger than the limit may still run. */
+	if (_workers.MaxThreads > 0 && wanted > _workers.MaxThreads)
+		wanted = _workers.MaxThreads > NewTaskCnt ? _workers.MaxThreads : NewTaskCnt;
+
+	while (_workers.ThreadCnt < wanted && !rc)
+	{
+		rc = workers_create_thread();
+	}
+	return rc;
+}
+
+void
+workers_set_max_threads(int MaxThreads)
+{
+	pthread_mutex_lock(&_workers.Lock);
+	{
+		_workers.MaxThreads = MaxThreads;
+		workers_grow(0);
+		workers_dispatch();
+	}
+	pthread_mutex_unlock(&_workers.Lock);
+}
+
+globus_result_t
+workers_group_init(workers_group_t ** Group)
+{
+	GlobusGFSName(workers_group_init);
+
+	*Group = malloc(sizeof(workers_group_t));
+	if (!*Group)
+		return GlobusGFSErrorMemory("workers_group_t");
+	memset(*Group, 0, sizeof(workers_group_t));
+	return GLOBUS_SUCCESS;
+}
+
+globus_result_t
+workers_group_add(workers_group_t * Group, workers_func_t Func, void * Arg)
+{
+	workers_task_t * task = NULL;
+
+	GlobusGFSName(workers_group_add);
+
+	task = malloc(sizeof(workers_task_t));
+	if (!task)
+		return GlobusGFSErrorMemory("workers_task_t");
+
+	task->Func = Func;
+	task->Arg  = Arg;
+	task->Next = NULL;
+
+	if (Group->TasksTail)
+		Group->TasksTail->Next = task;
+	else
+		Group->Tasks = task;
+	Group->TasksTail = task;
+	Group->TaskCnt++;
+
+	return GLOBUS_SUCCESS;
+}
+
+void
+workers_group_destroy(workers_group_t * Group)
+{
+	workers_task_t * task = NULL;
+
+	if (Group)
+	{
+		while ((task = Group->Tasks))
+		{
+			Group->Tasks = task->Next;
+			free(task);
+		}
+		free(Group);
+	}
+}
+
+globus_result_t
+workers_submit(workers_group_t * Group)
+{
+	int             rc     = 0;
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	GlobusGFSName(workers_submit);
+
+	pthread_mutex_lock(&_workers.Lock);
+	{
+		rc = workers_grow(Group->TaskCnt);
+
+		/* With fewer threads than tasks, this group could never start. */
+		if (_workers.ThreadCnt < Group->TaskCnt)
+		{
+			result = GlobusGFSErrorSystemError("pthread_create", rc);
+		} else
+		{
+			Group->Next = NULL;
+			if (_workers.QueueTail)
+				_workers.QueueTail->Next = Group;
+			else
+				_workers.Queue = Group;
+			_workers.QueueTail = Group;
+			_workers.PendingCnt += Group->TaskCnt;
+
+			workers_dispatch();
+		}
+	}
+	pthread_mutex_unlock(&_workers.Lock);
+
+	if (result)
+		workers_group_destroy(Group);
+
+	return result;
+}
+
+int
+workers_submit_now(workers_group_t * Group)
+{
+	int started = 0;
+
+	pthread_mutex_lock(&_workers.Lock);
+	{
+		workers_grow(Group->TaskCnt);
+
+		/* Queued groups go first, and this one must fit now. */
+		if (!_workers.Queue &&
+		    _workers.ThreadCnt - _workers.BusyCnt - _workers.ReadyCnt >= Group->TaskCnt)
+		{
+			Group->Next        = NULL;
+			_workers.Queue     = Group;
+			_workers.QueueTail = Group;
+			_workers.PendingCnt += Group->TaskCnt;
+
+			workers_dispatch();
+			started = 1;
+		}
+	}
+	pthread_mutex_unlock(&_workers.Lock);
+
+	if (!started)
+		workers_group_destroy(Group);
+
+	return started;
+}
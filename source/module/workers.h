@@ -0,0 +1,111 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef HPSS_DSI_WORKERS_H
+#define HPSS_DSI_WORKERS_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Process wide pool of worker threads for the PIO roles and other short
+ * parallel work. Threads are created on demand, up to the configured
+ * maximum, and kept for later use.
+ *
+ * Work is submitted in groups whose tasks wait on each other (a PIO
+ * coordinator and its participants). A group starts only when there is a
+ * free worker for every one of its tasks, so a partly started group can
+ * never hold workers that its other members are waiting for. Groups that
+ * don't fit yet are queued in order.
+ */
+
+typedef void * (*workers_func_t) (void * Arg);
+
+typedef struct workers_task {
+	workers_func_t        Func;
+	void                * Arg;
+	struct workers_task * Next;
+} workers_task_t;
+
+typedef struct workers_group {
+	workers_task_t       * Tasks;
+	workers_task_t       * TasksTail;
+	int                    TaskCnt;
+	struct workers_group * Next;
+} workers_group_t;
+
+/* 0 means no limit. Growing the limit starts any groups that now fit. */
+void
+workers_set_max_threads(int MaxThreads);
+
+globus_result_t
+workers_group_init(workers_group_t ** Group);
+
+globus_result_t
+workers_group_add(workers_group_t * Group, workers_func_t Func, void * Arg);
+
+/* Only for groups that were never submitted. */
+void
+workers_group_destroy(workers_group_t * Group);
+
+/*
+ * Takes ownership of Group. Fails if there are not, and can not be,
+ * enough threads to ever run it.
+ */
+globus_result_t
+workers_submit(workers_group_t * Group);
+
+/*
+ * Like workers_submit() but never queues. Returns 1 if the group started,
+ * or 0 and frees Group if there is no room for it right away. For work the
+ * caller can do itself; no room is common while transfers run, so it is
+ * not an error.
+ */
+int
+workers_submit_now(workers_group_t * Group);
+
+#endif /* HPSS_DSI_WORKERS_H */